@@ -3,16 +3,20 @@
 ButtonHandler::ButtonHandler(uint8_t pinA, uint8_t pinB)
     : pinA(pinA), pinB(pinB), buttonAState(false), buttonBState(false),
       longPressActiveA(false), lastPressTimeA(0), lastPressTimeB(0),
-      longPressRepeatTimeA(0), moveCallback(nullptr), isRunning(true) {
+      longPressRepeatTimeA(0), moveCallback(nullptr), startCallback(nullptr), isRunning(true) {
     // Initialize button pins
     pinMode(pinA, INPUT_PULLUP);
     pinMode(pinB, INPUT_PULLUP);
 }
 
-void ButtonHandler::setMoveCallback(std::function<void()> moveCallback) {
+void ButtonHandler::setMoveCallback(void (*moveCallback)()) {
     this->moveCallback = moveCallback;
 }
 
+void ButtonHandler::setStartCallback(bool (*startCallback)()) {
+    this->startCallback = startCallback;
+}
+
 void ButtonHandler::start() {
     isRunning = true;
     while (isRunning) {
@@ -67,7 +71,9 @@ void ButtonHandler::handleButtonB() {
         lastPressTimeB = currentTime;
 
         if (buttonBState) { // Button B pressed
-            isRunning = false; // End loop
+            if (!startCallback || startCallback()) {
+                isRunning = false; // End loop
+            }
         }
     }
 }
\ No newline at end of file
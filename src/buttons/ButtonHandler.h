@@ -2,7 +2,6 @@
 #define BUTTON_HANDLER_H
 
 #include <Arduino.h>
-#include <functional>
 
 class ButtonHandler {
 public:
@@ -10,7 +9,11 @@ public:
     ButtonHandler(uint8_t pinA, uint8_t pinB);
 
     // Set callback for move function
-    void setMoveCallback(std::function<void()> moveCallback);
+    void setMoveCallback(void (*moveCallback)());
+
+    // Set callback for the start button. start() ends when it returns true.
+    // Without callback the start button always ends start()
+    void setStartCallback(bool (*startCallback)());
 
     // Blocking control of the buttons
     void start();
@@ -34,7 +37,10 @@ private:
     const unsigned long longPressDelay = 500;    // 500 ms until long press starts
 
     // Callback function for “Move”
-    std::function<void()> moveCallback;
+    void (*moveCallback)();
+
+    // Callback function for “Start”
+    bool (*startCallback)();
 
     // Blocking status
     bool isRunning;
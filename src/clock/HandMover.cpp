@@ -0,0 +1,418 @@
+#include "HandMover.h"
+
+#include "esp_log.h"
+#include "trace/Trace.h"
+
+const char* HandMover::TAG = "hand_mover";
+
+HandMover::HandMover(HandPosition& position, gpio_num_t enablePin, gpio_num_t input1Pin, gpio_num_t input2Pin,
+                     uint8_t pwmChannel, const DriveProfile& profile, uint16_t pulseIntervalMs)
+  : _position(position),
+    _enablePin(enablePin),
+    _input1Pin(input1Pin),
+    _input2Pin(input2Pin),
+    _pwmChannel(pwmChannel),
+    _profile(profile),
+    _pulseIntervalMs(pulseIntervalMs),
+    _thermal(NULL),
+    _supplyVolts(0),
+    _pulseCallback(NULL),
+    _mux(portMUX_INITIALIZER_UNLOCKED),
+    _queued(0),
+    _backlog(0),
+    _minuteStep(false),
+    _holdUntil(0),
+    _pulses(0),
+    _chargeUc(0),
+    _lastPulseMs(0),
+    _throttleMs(0),
+    _lastCommitMs(0),
+    _waiters(),
+    _waiterId(0),
+    _queue(NULL),
+    _task(NULL) {
+
+}
+
+esp_err_t HandMover::start() {
+  if (_task != NULL) {
+    return ESP_OK; // Already running
+  }
+
+  pinMode(_enablePin, OUTPUT);
+  pinMode(_input1Pin, OUTPUT);
+  pinMode(_input2Pin, OUTPUT);
+  digitalWrite(_enablePin, LOW);
+
+  // Enable pin is driven by LEDC to shape the pulse
+  ledcSetup(_pwmChannel, PWM_FREQ, PWM_RESOLUTION);
+  ledcAttachPin(_enablePin, _pwmChannel);
+  ledcWrite(_pwmChannel, 0);
+
+  _queue = xQueueCreateStatic(QUEUE_LENGTH, sizeof(Command), _queueStorage, &_queueBuffer);
+
+  _task = xTaskCreateStaticPinnedToCore(task, TASK_PULSE_NAME, TASK_PULSE_STACK, this,
+                                        TASK_PULSE_PRIORITY, _taskStack, &_taskBuffer, TASK_PULSE_CORE);
+  if (_task == NULL) {
+    ESP_LOGE(TAG, "Failed to create task");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+bool HandMover::advance(uint16_t count) {
+  if (count == 0) {
+    return true;
+  }
+
+  portENTER_CRITICAL(&_mux);
+  _queued += count;
+  portEXIT_CRITICAL(&_mux);
+
+  if (!send({CommandType::Advance, count, 0, 0})) {
+    portENTER_CRITICAL(&_mux);
+    _queued -= count;
+    portEXIT_CRITICAL(&_mux);
+    return false;
+  }
+  return true;
+}
+
+bool HandMover::hold(time_t until) {
+  return send({CommandType::Hold, 0, until, 0});
+}
+
+bool HandMover::cancel() {
+  return send({CommandType::Cancel, 0, 0, 0});
+}
+
+bool HandMover::setPosition(uint16_t minutes) {
+  return send({CommandType::SetPosition, minutes, 0, 0});
+}
+
+void HandMover::setProfile(const DriveProfile& profile) {
+  portENTER_CRITICAL(&_mux);
+  _profile = profile;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void HandMover::setThermalModel(ThermalModel* model, float supplyVolts) {
+  portENTER_CRITICAL(&_mux);
+  _thermal = model;
+  _supplyVolts = supplyVolts;
+  portEXIT_CRITICAL(&_mux);
+}
+
+HandMover::Status HandMover::status() {
+  Status status;
+  ThermalModel model({0, 0, 0});
+  float joules;
+
+  portENTER_CRITICAL(&_mux);
+  status.position = _position.minutes();
+  status.backlog = _queued + _backlog;
+  status.holding = _holdUntil != 0;
+  status.pulses = _pulses;
+  status.chargeMc = _chargeUc / 1000;
+  status.throttleMs = _throttleMs;
+  portEXIT_CRITICAL(&_mux);
+
+  // Float math on a copy, outside of the critical section
+  bool thermal = thermalSnapshot(model, joules);
+  status.temperatureK = thermal ? model.temperatureK(millis()) : 0;
+  status.peakK = thermal ? model.peakK() : 0;
+
+  return status;
+}
+
+uint32_t HandMover::pulsePeriodMs(uint16_t count) {
+  portENTER_CRITICAL(&_mux);
+  uint32_t widthMs = _profile.widthMs();
+  portEXIT_CRITICAL(&_mux);
+
+  ThermalModel model({0, 0, 0});
+  float joules;
+  if (count == 0 || !thermalSnapshot(model, joules)) {
+    return widthMs + _pulseIntervalMs;
+  }
+  return model.burstMs(count, joules, widthMs, _pulseIntervalMs, millis()) / count;
+}
+
+bool HandMover::thermalSnapshot(ThermalModel& model, float& joules) {
+  portENTER_CRITICAL(&_mux);
+  bool valid = _thermal != NULL;
+  if (valid) {
+    model = *_thermal;
+  }
+  float volts = _supplyVolts;
+  uint32_t chargeUc = _profile.chargeUc();
+  portEXIT_CRITICAL(&_mux);
+
+  // Heat of the next pulse with the current profile
+  joules = volts * chargeUc / 1000000.0f;
+  return valid;
+}
+
+bool HandMover::waitIdle(TickType_t timeout) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  int slot = -1;
+  uint32_t id = 0;
+
+  portENTER_CRITICAL(&_mux);
+  for (int i = 0; i < MAX_WAITERS; i++) {
+    if (_waiters[i].task == NULL) {
+      slot = i;
+      id = ++_waiterId;
+      _waiters[i] = {self, id, false};
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&_mux);
+
+  if (slot < 0) {
+    ESP_LOGE(TAG, "Too many tasks in waitIdle()");
+    return false;
+  }
+
+  // The command is queued behind all earlier commands, so they are applied first
+  if (!send({CommandType::NotifyIdle, (uint16_t)slot, 0, id})) {
+    portENTER_CRITICAL(&_mux);
+    _waiters[slot].task = NULL;
+    portEXIT_CRITICAL(&_mux);
+    return false;
+  }
+  if (ulTaskNotifyTake(pdTRUE, timeout) > 0) {
+    return true;
+  }
+
+  // Timeout: free the slot, unless the notification came in the meantime
+  portENTER_CRITICAL(&_mux);
+  bool notified = _waiters[slot].id != id || _waiters[slot].task == NULL;
+  if (!notified) {
+    _waiters[slot].task = NULL;
+  }
+  portEXIT_CRITICAL(&_mux);
+  if (notified) {
+    // Claimed by notifyWaiters(), consume the notification that follows
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  return notified;
+}
+
+bool HandMover::send(const Command& command) {
+  if (_queue == NULL || xQueueSend(_queue, &command, 0) != pdTRUE) {
+    ESP_LOGW(TAG, "Command %d dropped", (int)command.type);
+    return false;
+  }
+  return true;
+}
+
+void HandMover::process(const Command& command) {
+  portENTER_CRITICAL(&_mux);
+  switch (command.type) {
+    case CommandType::Advance:
+      // Merge with the pending requests into one burst
+      _queued -= command.value;
+      _minuteStep = command.value == 1 && _backlog == 0 && _queued == 0;
+      _backlog += command.value;
+      break;
+    case CommandType::Hold:
+      _holdUntil = command.until;
+      break;
+    case CommandType::Cancel:
+      _backlog = 0;
+      _minuteStep = false;
+      _holdUntil = 0;
+      break;
+    case CommandType::SetPosition:
+      // RAM and RTC memory only, NVS follows when idle
+      _position.set(command.value);
+      _backlog = 0;
+      _minuteStep = false;
+      break;
+    case CommandType::NotifyIdle:
+      // Ignore a command whose waiter has timed out already
+      if (_waiters[command.value].id == command.waiterId && _waiters[command.value].task != NULL) {
+        _waiters[command.value].armed = true;
+      }
+      break;
+  }
+  portEXIT_CRITICAL(&_mux);
+}
+
+uint32_t HandMover::pulseWaitMs() {
+  uint32_t now = millis();
+  uint32_t wait = 0;
+
+  // Mechanical minimum between two pulses
+  uint32_t elapsed = now - _lastPulseMs;
+  if (_pulses > 0 && elapsed < _pulseIntervalMs) {
+    wait = _pulseIntervalMs - elapsed;
+  }
+
+  // Cooling time so the next pulse stays below the limit
+  ThermalModel model({0, 0, 0});
+  float joules;
+  if (thermalSnapshot(model, joules)) {
+    wait = max(wait, model.coolingTimeMs(joules, now));
+  }
+
+  return wait;
+}
+
+void HandMover::pulse() {
+  int level = _position.level();
+
+  // Only this task changes the thermal model, so a copy can be updated
+  // outside of the critical section and written back
+  ThermalModel model({0, 0, 0});
+  portENTER_CRITICAL(&_mux);
+  DriveProfile profile = _profile;
+  bool minuteStep = _minuteStep;
+  _minuteStep = false;
+  bool thermal = _thermal != NULL;
+  if (thermal) {
+    model = *_thermal;
+  }
+  float volts = _supplyVolts;
+  portEXIT_CRITICAL(&_mux);
+
+  // direction of current
+  digitalWrite(_input1Pin, level);
+  digitalWrite(_input2Pin, !level);
+
+  TRACE_EVENT(PulseStart, level);
+  if (_pulseCallback != NULL) {
+    _pulseCallback(minuteStep); // The coil is energised from here on
+  }
+
+  // Soft ramp, one step per tick
+  for (uint16_t ms = 1; ms <= profile.rampMs; ms++) {
+    ledcWrite(_pwmChannel, PWM_MAX * ms / profile.rampMs);
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+
+  // Full power until the armature has moved
+  ledcWrite(_pwmChannel, PWM_MAX);
+  vTaskDelay(pdMS_TO_TICKS(profile.kickMs));
+
+  // Reduced duty to hold the armature
+  if (profile.holdMs > 0) {
+    ledcWrite(_pwmChannel, PWM_MAX * profile.holdDuty / 100);
+    vTaskDelay(pdMS_TO_TICKS(profile.holdMs));
+  }
+
+  // End the pulse
+  ledcWrite(_pwmChannel, 0);
+  TRACE_EVENT(PulseEnd, level);
+
+  _lastPulseMs = millis();
+
+  if (thermal) {
+    // All energy from the supply ends up as heat in L293D and coil
+    model.addHeat(volts * profile.chargeUc() / 1000000.0f, _lastPulseMs);
+  }
+
+  // Position and backlog change together, so status() never sees the pulse
+  // counted twice or not at all. NVS follows when idle
+  portENTER_CRITICAL(&_mux);
+  _position.step();
+  _backlog--;
+  _pulses++;
+  _chargeUc += profile.chargeUc();
+  if (thermal && _thermal != NULL) {
+    *_thermal = model;
+  }
+  portEXIT_CRITICAL(&_mux);
+}
+
+void HandMover::notifyWaiters() {
+  TaskHandle_t tasks[MAX_WAITERS];
+  int count = 0;
+
+  portENTER_CRITICAL(&_mux);
+  for (int i = 0; i < MAX_WAITERS; i++) {
+    if (_waiters[i].task != NULL && _waiters[i].armed) {
+      tasks[count++] = _waiters[i].task;
+      _waiters[i].task = NULL;
+      _waiters[i].armed = false;
+    }
+  }
+  portEXIT_CRITICAL(&_mux);
+
+  for (int i = 0; i < count; i++) {
+    xTaskNotifyGive(tasks[i]);
+  }
+}
+
+void HandMover::run() {
+  Command command;
+
+  while (true) {
+    // A hold ends when its time has come, with or without a backlog
+    time_t now = time(NULL);
+    bool holdEnded = false;
+    portENTER_CRITICAL(&_mux);
+    if (_holdUntil != 0 && now >= _holdUntil) {
+      _holdUntil = 0;
+      holdEnded = true;
+    }
+    bool holding = _holdUntil != 0;
+    portEXIT_CRITICAL(&_mux);
+    if (holdEnded) {
+      ESP_LOGI(TAG, "Hold ended");
+    }
+
+    Status current = status();
+
+    // Write NVS when the backlog is done, and on a timer during long bursts.
+    // RTC memory covers resets in between
+    if (_position.dirty() && (current.backlog == 0 || millis() - _lastCommitMs >= COMMIT_INTERVAL_MS)) {
+      _position.commit();
+      _lastCommitMs = millis();
+    }
+
+    // Backlog done, wake up the tasks in waitIdle()
+    if (current.backlog == 0) {
+      notifyWaiters();
+    }
+
+    // Wait for commands. While pulses are due, wait only for the pulse interval
+    // and cooling, wake up when a hold ends
+    TickType_t timeout = portMAX_DELAY;
+    uint32_t waitMs = 0;
+    if (current.backlog > 0 && !holding) {
+      waitMs = pulseWaitMs();
+      timeout = pdMS_TO_TICKS(waitMs);
+    } else if (holding) {
+      timeout = pdMS_TO_TICKS(1000);
+    }
+
+    if (xQueueReceive(_queue, &command, timeout) == pdTRUE) {
+      process(command);
+      while (xQueueReceive(_queue, &command, 0) == pdTRUE) {
+        process(command);
+      }
+      continue; // Re-evaluate with all commands applied
+    }
+
+    if (holding || _backlog == 0) {
+      continue;
+    }
+
+    if (waitMs > _pulseIntervalMs) {
+      portENTER_CRITICAL(&_mux);
+      _throttleMs += waitMs - _pulseIntervalMs;
+      portEXIT_CRITICAL(&_mux);
+      ESP_LOGD(TAG, "Waited %u ms for cooling", waitMs);
+    }
+    if (current.backlog > 1) {
+      ESP_LOGD(TAG, "Backlog %d", current.backlog);
+    }
+    pulse();
+  }
+}
+
+void HandMover::task(void* param) {
+  static_cast<HandMover*>(param)->run();
+}
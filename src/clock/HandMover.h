@@ -0,0 +1,170 @@
+#ifndef HAND_MOVER_H
+#define HAND_MOVER_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "config/TaskConfig.h"
+#include "HandPosition.h"
+#include "ThermalModel.h"
+
+// Movement service. Owns the L293D and is the only code that sends pulses.
+// Commands are queued and never block the caller. Pending advance requests
+// are merged into one burst, so the polarity sequence stays correct with any
+// number of producers. With a thermal model, bursts run at the minimum
+// interval and slow down only when the modeled temperature nears the limit.
+class HandMover {
+public:
+  /**
+   * @brief Consistent copy of the movement state.
+   */
+  struct Status {
+    uint16_t position;   // Current position of the hands in minutes
+    uint16_t backlog;    // Pulses requested but not sent yet
+    bool holding;        // Movement paused by hold()
+    uint32_t pulses;     // Total pulses sent
+    uint32_t chargeMc;   // Total coil charge in millicoulomb (mA * s)
+    float temperatureK;  // Modeled temperature rise of L293D and coil, 0 without model
+    float peakK;         // Highest modeled temperature rise
+    uint32_t throttleMs; // Total time pulses waited for cooling beyond the interval
+  };
+
+  /**
+   * @brief Drive waveform of one pulse on the enable pin: optional soft ramp,
+   * full power kick to move the armature, then reduced duty to hold it.
+   */
+  struct DriveProfile {
+    uint16_t rampMs;     // Ramp from 0 to full duty, 0 for none
+    uint16_t kickMs;     // Full duty
+    uint16_t holdMs;     // Reduced duty
+    uint8_t holdDuty;    // Duty while holding in percent
+    uint16_t coilMa;     // Coil current at full duty, for the charge accounting
+
+    uint16_t widthMs() const { return rampMs + kickMs + holdMs; }
+
+    // Charge per pulse in microcoulomb, assuming the current follows the duty
+    uint32_t chargeUc() const {
+      return (uint32_t)coilMa * (rampMs / 2 + kickMs + (uint32_t)holdMs * holdDuty / 100);
+    }
+  };
+
+  HandMover(HandPosition& position, gpio_num_t enablePin, gpio_num_t input1Pin, gpio_num_t input2Pin,
+            uint8_t pwmChannel, const DriveProfile& profile, uint16_t pulseIntervalMs);
+
+  // Change the drive profile, used from the next pulse
+  void setProfile(const DriveProfile& profile);
+
+  // Limit the pulse rate by the modeled temperature. NULL disables the limit
+  void setThermalModel(ThermalModel* model, float supplyVolts);
+
+  // Called from the pulse task when the coil is energised. minuteStep is true
+  // for a single pulse requested with an empty backlog, false within a burst
+  void setPulseCallback(void (*callback)(bool minuteStep)) { _pulseCallback = callback; }
+
+  // Init the pins and start the pulse task, see config/TaskConfig.h
+  esp_err_t start();
+
+  // Advance the hands by count minutes
+  bool advance(uint16_t count);
+
+  // Don't move the hands before the given time. 0 ends the hold
+  bool hold(time_t until);
+
+  // Drop the backlog and end a hold
+  bool cancel();
+
+  // Set the position after manual setup of the hands. Drops the backlog
+  bool setPosition(uint16_t minutes);
+
+  Status status();
+
+  // Expected time per pulse for a burst of count pulses, including the cooling
+  // waits of the thermal model. Pulse width plus interval without a model
+  uint32_t pulsePeriodMs(uint16_t count);
+
+  TaskHandle_t taskHandle() const { return _task; }
+
+  // Block until all commands sent before are done. Uses the task notification of the caller.
+  // Up to MAX_WAITERS tasks may wait at the same time, more are rejected with false
+  bool waitIdle(TickType_t timeout = portMAX_DELAY);
+
+  static const int MAX_WAITERS = 4;
+
+private:
+  enum class CommandType : uint8_t {
+    Advance,
+    Hold,
+    Cancel,
+    SetPosition,
+    NotifyIdle
+  };
+
+  struct Command {
+    CommandType type;
+    uint16_t value;      // Minutes, or the waiter slot for NotifyIdle
+    time_t until;
+    uint32_t waiterId;   // Guards against a slot reused after a timeout
+  };
+
+  // Task blocked in waitIdle(). Armed when its NotifyIdle command is processed
+  struct Waiter {
+    TaskHandle_t task;
+    uint32_t id;
+    bool armed;
+  };
+
+  static const char* TAG;
+  static const int QUEUE_LENGTH = 8;
+  static const uint32_t PWM_FREQ = 4000;   // The L293D switches up to 5 kHz
+  static const uint8_t PWM_RESOLUTION = 8;
+  static const uint32_t PWM_MAX = (1 << PWM_RESOLUTION) - 1;
+  static const uint32_t COMMIT_INTERVAL_MS = 60000;  // NVS write during long bursts
+
+  HandPosition& _position;
+  gpio_num_t _enablePin;
+  gpio_num_t _input1Pin;
+  gpio_num_t _input2Pin;
+  uint8_t _pwmChannel;
+  DriveProfile _profile;
+  uint16_t _pulseIntervalMs;   // Minimum time between pulses
+  ThermalModel* _thermal;
+  float _supplyVolts;
+  void (*_pulseCallback)(bool minuteStep);
+
+  portMUX_TYPE _mux;
+  uint16_t _queued;    // Sum of advance commands still in the queue
+  uint16_t _backlog;   // Merged advance commands taken from the queue
+  bool _minuteStep;    // The backlog is a single regular minute step
+  time_t _holdUntil;
+  uint32_t _pulses;
+  uint64_t _chargeUc;
+  uint32_t _lastPulseMs;
+  uint32_t _throttleMs;
+  uint32_t _lastCommitMs;
+  Waiter _waiters[MAX_WAITERS];  // Notified when the backlog is done
+  uint32_t _waiterId;
+
+  StaticQueue_t _queueBuffer;
+  uint8_t _queueStorage[QUEUE_LENGTH * sizeof(Command)];
+  QueueHandle_t _queue;
+
+  StackType_t _taskStack[TASK_PULSE_STACK];
+  StaticTask_t _taskBuffer;
+  TaskHandle_t _task;
+
+  bool send(const Command& command);
+  // Copy of the thermal model and the heat of one pulse. The float math runs on
+  // the copy, outside of the critical section. False without a model
+  bool thermalSnapshot(ThermalModel& model, float& joules);
+  void process(const Command& command);
+  uint32_t pulseWaitMs();
+  void pulse();
+  void notifyWaiters();
+  void run();
+  static void task(void* param);
+};
+
+#endif // HAND_MOVER_H
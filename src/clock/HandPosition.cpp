@@ -0,0 +1,95 @@
+#include "HandPosition.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+
+const char* HandPosition::TAG = "hand_position";
+const char* HandPosition::NVS_NAMESPACE = "CLOCK";
+const char* HandPosition::POSITION_VALUE = "POS";
+
+RTC_NOINIT_ATTR HandPosition::Retained HandPosition::retained;
+
+HandPosition::HandPosition(uint16_t dialMinutes)
+  : _dialMinutes(dialMinutes), _minutes(0), _level(0), _persistent(true), _dirty(false) {
+
+}
+
+bool HandPosition::restore() {
+  // RTC memory is up to date even if a reset interrupted a pulse burst
+  if (retained.magic == MAGIC && retained.checksum == checksum(retained) && retained.minutes < _dialMinutes) {
+    _minutes = retained.minutes;
+    _level = retained.level;
+    ESP_LOGI(TAG, "Position from RTC memory: %u, level %u", _minutes, _level);
+    // NVS may lag behind if the reset came before a commit
+    _dirty = true;
+    return true;
+  }
+
+  nvs_handle_t handle;
+  uint32_t value;
+  if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    ESP_LOGW(TAG, "No position stored");
+    return false;
+  }
+  esp_err_t err = nvs_get_u32(handle, POSITION_VALUE, &value);
+  nvs_close(handle);
+  if (err != ESP_OK || (value & 0xFFFF) >= _dialMinutes) {
+    ESP_LOGW(TAG, "No position stored");
+    return false;
+  }
+
+  _minutes = value & 0xFFFF;
+  _level = (value >> 16) & 1;
+  ESP_LOGI(TAG, "Position from NVS: %u, level %u", _minutes, _level);
+  store();
+  return true;
+}
+
+void HandPosition::set(uint16_t minutes) {
+  _minutes = minutes % _dialMinutes;
+  store();
+  _dirty = true;
+}
+
+void HandPosition::step() {
+  _minutes = (_minutes + 1) % _dialMinutes;
+  _level = !_level;
+  store();
+  _dirty = true;
+}
+
+void HandPosition::store() {
+  retained.magic = MAGIC;
+  retained.minutes = _minutes;
+  retained.level = _level;
+  retained.checksum = checksum(retained);
+}
+
+void HandPosition::commit() {
+  if (!_dirty || !_persistent) {
+    return;
+  }
+
+  // NVS spreads the writes over its pages, one write per minute is fine for the flash
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open NVS %d", err);
+    return;
+  }
+  err = nvs_set_u32(handle, POSITION_VALUE, ((uint32_t)_level << 16) | _minutes);
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  if (err == ESP_OK) {
+    _dirty = false;
+  } else {
+    ESP_LOGE(TAG, "Failed to store position %d", err);
+  }
+  nvs_close(handle);
+}
+
+uint8_t HandPosition::checksum(const Retained& data) {
+  return (uint8_t)(data.minutes ^ (data.minutes >> 8) ^ data.level ^ 0xA5);
+}
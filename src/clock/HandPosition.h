@@ -0,0 +1,61 @@
+#ifndef HAND_POSITION_H
+#define HAND_POSITION_H
+
+#include <Arduino.h>
+#include "esp_err.h"
+
+// Position of the hands and polarity of the next pulse.
+// Kept in RTC memory on every change (survives resets and deep sleep) and
+// written to NVS by commit() (survives power cuts).
+class HandPosition {
+public:
+  // Constructor, dialMinutes is 720 for a 12-hour and 1440 for a 24-hour clock
+  HandPosition(uint16_t dialMinutes);
+
+  // Restore the position from RTC memory or NVS. Returns false if it is unknown
+  bool restore();
+
+  // Set the position after manual setup of the hands. RTC memory only
+  void set(uint16_t minutes);
+
+  // Advance the position after one pulse and toggle the polarity. RTC memory only
+  void step();
+
+  // Write the position to NVS if it changed since the last commit
+  void commit();
+
+  // Position differs from NVS
+  bool dirty() const { return _dirty; }
+
+  // Allow commit() to write NVS. Disabled in the deep sleep wake path until NVS is initialized
+  void setPersistent(bool persistent) { _persistent = persistent; }
+
+  uint16_t minutes() const { return _minutes; }
+  uint8_t level() const { return _level; }
+  uint16_t dialMinutes() const { return _dialMinutes; }
+
+private:
+  static const char* TAG;
+  static const char* NVS_NAMESPACE;
+  static const char* POSITION_VALUE;
+  static const uint32_t MAGIC = 0x48414E44; // "HAND"
+
+  struct Retained {
+    uint32_t magic;
+    uint16_t minutes;
+    uint8_t level;
+    uint8_t checksum;
+  };
+  static Retained retained;
+
+  uint16_t _dialMinutes;
+  uint16_t _minutes;
+  uint8_t _level;
+  bool _persistent;
+  bool _dirty;
+
+  void store();
+  static uint8_t checksum(const Retained& data);
+};
+
+#endif // HAND_POSITION_H
@@ -0,0 +1,67 @@
+#include "HandTracker.h"
+
+HandTracker::HandTracker(uint16_t dialMinutes)
+  : _dialMinutes(dialMinutes), _stats{0, 0, 0, 0, 0, 0}, _correcting(false), _errorSinceMs(0) {
+
+}
+
+uint16_t HandTracker::dialPosition(const struct tm& time) const {
+  // For a 12-hour clock, the hours 12-23 are used to calculate the value 0-11
+  return ((time.tm_hour * 60) + time.tm_min) % _dialMinutes;
+}
+
+uint16_t HandTracker::difference(uint16_t position, const struct tm& time) const {
+  int32_t difference = (int32_t)dialPosition(time) - position;
+
+  // Handle negative differences (e.g., crossing midnight or wrapping around the 12-hour format)
+  if (difference < 0) {
+    difference += _dialMinutes; // Time always goes forward :-)
+  }
+  return difference;
+}
+
+uint16_t HandTracker::plan(uint16_t position, const struct tm& time, uint32_t pulseMs) const {
+  uint16_t forward = difference(position, time);
+  uint16_t ahead = forward > 0 ? _dialMinutes - forward : 0;
+
+  // Hold: the time reaches the hands sooner than the hands could go round the dial
+  if (forward > 1 && (uint32_t)ahead * 60000 < (uint32_t)forward * pulseMs) {
+    return 0;
+  }
+  return forward;
+}
+
+uint16_t HandTracker::maxHoldMinutes(uint32_t pulseMs) const {
+  // plan() holds while ahead * 60000 < (dialMinutes - ahead) * pulseMs
+  uint64_t limit = (uint64_t)_dialMinutes * pulseMs;
+  if (limit == 0) {
+    return 0;
+  }
+  return (limit - 1) / (60000 + pulseMs);
+}
+
+void HandTracker::observe(uint16_t difference, uint32_t nowMs) {
+  // The hands can be ahead or behind, the error is the shorter distance
+  uint16_t error = difference < _dialMinutes - difference ? difference : _dialMinutes - difference;
+  if (error > _stats.maxErrorMinutes) {
+    _stats.maxErrorMinutes = error;
+  }
+
+  // One minute is the regular step, more is an error to correct
+  if (error > 1 && !_correcting) {
+    _correcting = true;
+    _errorSinceMs = nowMs;
+    _stats.corrections++;
+  } else if (error <= 1 && _correcting) {
+    _correcting = false;
+    _stats.lastCorrectMs = nowMs - _errorSinceMs;
+    if (_stats.lastCorrectMs > _stats.maxCorrectMs) {
+      _stats.maxCorrectMs = _stats.lastCorrectMs;
+    }
+  }
+}
+
+void HandTracker::recordPulses(uint16_t count, uint16_t pulseWidthMs) {
+  _stats.pulses += count;
+  _stats.coilOnMs += (uint32_t)count * pulseWidthMs;
+}
@@ -0,0 +1,53 @@
+#ifndef HAND_TRACKER_H
+#define HAND_TRACKER_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Calculates the pulses needed to bring the hands to the current time and
+// keeps statistics about the movement. Plain C++, no Arduino or ESP-IDF dependency.
+class HandTracker {
+public:
+  struct Stats {
+    uint32_t pulses;            // Total pulses sent
+    uint32_t coilOnMs;          // Total time the coil was energized
+    uint16_t maxErrorMinutes;   // Largest difference between hands and time
+    uint32_t maxCorrectMs;      // Longest time from detecting an error until the hands were correct
+    uint32_t lastCorrectMs;     // Duration of the last correction
+    uint32_t corrections;       // Number of corrections (error of more than one minute)
+  };
+
+  // Constructor, dialMinutes is 720 for a 12-hour and 1440 for a 24-hour clock
+  HandTracker(uint16_t dialMinutes);
+
+  // Position on the dial for the given local time
+  uint16_t dialPosition(const struct tm& time) const;
+
+  // Minutes the hands have to advance from position to show the given time
+  uint16_t difference(uint16_t position, const struct tm& time) const;
+
+  // Pulses to send now. 0 if the hands are a little ahead and waiting for the
+  // time is faster than a full turn. pulseMs is the time per pulse of the burst
+  uint16_t plan(uint16_t position, const struct tm& time, uint32_t pulseMs) const;
+
+  // Most minutes the hands can be ahead and plan() still holds, for a turn of
+  // the dial at pulseMs per pulse
+  uint16_t maxHoldMinutes(uint32_t pulseMs) const;
+
+  // Record the difference between the hands as they stand and the time at nowMs,
+  // without pulses still to be sent
+  void observe(uint16_t difference, uint32_t nowMs);
+
+  // Record pulses that have been sent
+  void recordPulses(uint16_t count, uint16_t pulseWidthMs);
+
+  const Stats& stats() const { return _stats; }
+
+private:
+  uint16_t _dialMinutes;
+  Stats _stats;
+  bool _correcting;
+  uint32_t _errorSinceMs;
+};
+
+#endif // HAND_TRACKER_H
@@ -0,0 +1,58 @@
+#include "ThermalModel.h"
+
+#include <math.h>
+
+ThermalModel::ThermalModel(const Parameters& parameters)
+  : _parameters(parameters), _temperature(0), _peak(0), _lastMs(0) {
+
+}
+
+float ThermalModel::decayed(uint32_t nowMs) const {
+  float tau = _parameters.resistanceKW * _parameters.capacitanceJK;
+  float elapsed = (nowMs - _lastMs) / 1000.0f;
+  return _temperature * expf(-elapsed / tau);
+}
+
+void ThermalModel::addHeat(float joules, uint32_t nowMs) {
+  _temperature = decayed(nowMs) + joules / _parameters.capacitanceJK;
+  _lastMs = nowMs;
+  if (_temperature > _peak) {
+    _peak = _temperature;
+  }
+}
+
+uint32_t ThermalModel::coolingTimeMs(float joules, uint32_t nowMs) const {
+  float temperature = decayed(nowMs);
+
+  // Temperature that still leaves room for the next pulse
+  float allowed = _parameters.limitK - joules / _parameters.capacitanceJK;
+  if (temperature <= allowed) {
+    return 0;
+  }
+  if (allowed <= 0) {
+    allowed = _parameters.limitK / 2; // A single pulse exceeds the limit, cool down to half
+  }
+
+  float tau = _parameters.resistanceKW * _parameters.capacitanceJK;
+  return (uint32_t)(tau * logf(temperature / allowed) * 1000.0f) + 1;
+}
+
+float ThermalModel::temperatureK(uint32_t nowMs) const {
+  return decayed(nowMs);
+}
+
+uint32_t ThermalModel::burstMs(uint16_t count, float joules, uint32_t widthMs, uint32_t intervalMs,
+                               uint32_t nowMs) const {
+  // Run the burst on a copy, the same way HandMover schedules the pulses
+  ThermalModel model(*this);
+  uint32_t ms = nowMs;
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t wait = model.coolingTimeMs(joules, ms);
+    if (i > 0 && wait < intervalMs) {
+      wait = intervalMs;
+    }
+    ms += wait + widthMs;
+    model.addHeat(joules, ms);
+  }
+  return ms - nowMs;
+}
@@ -0,0 +1,45 @@
+#ifndef THERMAL_MODEL_H
+#define THERMAL_MODEL_H
+
+#include <stdint.h>
+
+// First order RC model of the temperature rise of L293D and coil.
+// Every pulse adds its energy, between the pulses the heat flows off with
+// the time constant R * C. Plain C++, no Arduino or ESP-IDF dependency.
+// Only addHeat() changes the state, the queries work on a copy as well.
+class ThermalModel {
+public:
+  struct Parameters {
+    float resistanceKW;    // Thermal resistance to ambient in K/W
+    float capacitanceJK;   // Thermal capacitance in J/K
+    float limitK;          // Maximum temperature rise above ambient in K
+  };
+
+  ThermalModel(const Parameters& parameters);
+
+  // Add the heat of a pulse that ended at nowMs
+  void addHeat(float joules, uint32_t nowMs);
+
+  // Time to wait so that a pulse with the given heat keeps the rise below the limit
+  uint32_t coolingTimeMs(float joules, uint32_t nowMs) const;
+
+  // Modeled temperature rise at nowMs
+  float temperatureK(uint32_t nowMs) const;
+
+  // Duration of a burst of count pulses starting at nowMs, each widthMs long and
+  // at least intervalMs apart, with the cooling waits the limit requires
+  uint32_t burstMs(uint16_t count, float joules, uint32_t widthMs, uint32_t intervalMs, uint32_t nowMs) const;
+
+  // Highest modeled temperature rise so far
+  float peakK() const { return _peak; }
+
+private:
+  Parameters _parameters;
+  float _temperature;
+  float _peak;
+  uint32_t _lastMs;
+
+  float decayed(uint32_t nowMs) const;
+};
+
+#endif // THERMAL_MODEL_H
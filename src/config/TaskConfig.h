@@ -0,0 +1,63 @@
+#ifndef TASK_CONFIG_H
+#define TASK_CONFIG_H
+
+// Task model of the firmware. All task priorities, cores and stack sizes in one place.
+// All tasks are created with static stacks. loop() logs the bytes each task has
+// used so far and fails the load test when less than TASK_STACK_HEADROOM is left.
+//
+// The stack sizes below are estimates until they are measured. To measure them, run
+// the load test (-DSLAVECLOCK_LOAD_TEST) for some hours, including a time sync, an
+// OTA check and a DST change, then:
+//
+//   python3 tools/stack_sizes.py monitor.log
+//
+// and enter the sizes it derives, with the used bytes, here.
+//
+// Core 0: WiFi driver, lwIP, default event loop, SNTP, the networking tasks and OTA
+// Core 1: Real-time pulse task, UI task and the Arduino loop() (priority 1)
+//
+// The pulse task has the highest priority of the application, so SPI redraws,
+// logging and networking can never delay a pulse by more than one tick.
+
+// Bytes that must stay free above the high water mark of every task
+#define TASK_STACK_HEADROOM 1024
+
+// Real-time pulse task of HandMover, drives the L293D
+#define TASK_PULSE_NAME     "MoveHands"
+#define TASK_PULSE_PRIORITY 10
+#define TASK_PULSE_CORE     1
+#define TASK_PULSE_STACK    3072
+
+// Time keeper task, compares hands and time and requests the pulses
+#define TASK_TIME_NAME      "TimeKeeper"
+#define TASK_TIME_PRIORITY  5
+#define TASK_TIME_CORE      1
+#define TASK_TIME_STACK     3072
+
+// UI task, draws time and status on the TFT
+#define TASK_UI_NAME        "DisplayTime"
+#define TASK_UI_PRIORITY    1
+#define TASK_UI_CORE        1
+#define TASK_UI_STACK       4096
+
+// Network task, connects WiFi in the background and syncs the time periodically
+#define TASK_NETWORK_NAME     "Network"
+#define TASK_NETWORK_PRIORITY 2
+#define TASK_NETWORK_CORE     0
+#define TASK_NETWORK_STACK    4096
+
+// OTA task, downloads and applies delta updates. Lowest priority, flash writes
+// stall the cache of both cores for a few ms per sector
+#define TASK_OTA_NAME       "DeltaOta"
+#define TASK_OTA_PRIORITY   1
+#define TASK_OTA_CORE       0
+#define TASK_OTA_STACK      4096
+
+// Load generator tasks, only with -DSLAVECLOCK_LOAD_TEST
+#define TASK_LOAD_DISPLAY_PRIORITY TASK_UI_PRIORITY
+#define TASK_LOAD_DISPLAY_CORE     TASK_UI_CORE
+#define TASK_LOAD_NETWORK_PRIORITY 2
+#define TASK_LOAD_NETWORK_CORE     0
+#define TASK_LOAD_STACK            3072
+
+#endif // TASK_CONFIG_H
@@ -0,0 +1,54 @@
+// Generated by tools/gen_font_subset.py, do not edit.
+// Glyphs: "0123456789:"
+#ifndef FONT_SUBSET_H
+#define FONT_SUBSET_H
+
+#include <stdint.h>
+
+namespace FontSubset {
+
+struct Glyph {
+  char code;
+  uint8_t width;     // Columns of the bitmap
+  uint8_t advance;   // Columns to the next glyph
+  uint16_t offset;   // First byte in BITMAP
+};
+
+constexpr uint8_t HEIGHT = 13;  // Rows of every glyph
+constexpr uint8_t SCALE = 2;   // Screen pixels per bitmap pixel
+
+// Sorted by code
+constexpr Glyph GLYPHS[] = {
+  { '0', 7, 8, 0 },
+  { '1', 7, 8, 13 },
+  { '2', 7, 8, 26 },
+  { '3', 7, 8, 39 },
+  { '4', 7, 8, 52 },
+  { '5', 7, 8, 65 },
+  { '6', 7, 8, 78 },
+  { '7', 7, 8, 91 },
+  { '8', 7, 8, 104 },
+  { '9', 7, 8, 117 },
+  { ':', 2, 3, 130 },
+};
+
+constexpr uint8_t GLYPH_COUNT = sizeof(GLYPHS) / sizeof(GLYPHS[0]);
+
+// 1 bit per pixel, MSB left, every row padded to whole bytes
+constexpr uint8_t BITMAP[] = {
+  0x38, 0x6C, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0x6C, 0x38,
+  0x18, 0x38, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7E,
+  0x7C, 0xC6, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0xC0, 0xC0, 0xFE,
+  0x7C, 0xC6, 0x06, 0x06, 0x06, 0x3C, 0x06, 0x06, 0x06, 0x06, 0x06, 0xC6, 0x7C,
+  0x0C, 0x1C, 0x3C, 0x6C, 0xCC, 0xCC, 0xFE, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C,
+  0xFE, 0xC0, 0xC0, 0xC0, 0xFC, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0xC6, 0x7C,
+  0x3C, 0x60, 0xC0, 0xC0, 0xC0, 0xFC, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0x7C,
+  0xFE, 0x06, 0x06, 0x0C, 0x0C, 0x18, 0x18, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,
+  0x7C, 0xC6, 0xC6, 0xC6, 0xC6, 0x7C, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0x7C,
+  0x7C, 0xC6, 0xC6, 0xC6, 0xC6, 0xC6, 0x7E, 0x06, 0x06, 0x06, 0x06, 0x0C, 0x78,
+  0x00, 0x00, 0x00, 0xC0, 0xC0, 0x00, 0x00, 0x00, 0xC0, 0xC0, 0x00, 0x00, 0x00,
+};
+
+} // namespace FontSubset
+
+#endif // FONT_SUBSET_H
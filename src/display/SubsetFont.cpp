@@ -0,0 +1,54 @@
+#include "SubsetFont.h"
+
+const FontSubset::Glyph* SubsetFont::find(char code) {
+  // A handful of glyphs, sorted by code
+  for (uint8_t i = 0; i < FontSubset::GLYPH_COUNT && FontSubset::GLYPHS[i].code <= code; i++) {
+    if (FontSubset::GLYPHS[i].code == code) {
+      return &FontSubset::GLYPHS[i];
+    }
+  }
+  return NULL;
+}
+
+int32_t SubsetFont::textWidth(const char* text) {
+  int32_t width = 0;
+
+  for (; *text != '\0'; text++) {
+    const FontSubset::Glyph* glyph = find(*text);
+    if (glyph != NULL) {
+      width += glyph->advance * FontSubset::SCALE;
+    }
+  }
+  return width;
+}
+
+int32_t SubsetFont::drawString(TFT_eSprite& sprite, const char* text, int32_t x, int32_t y, uint32_t color) {
+  const int32_t scale = FontSubset::SCALE;
+
+  for (; *text != '\0'; text++) {
+    const FontSubset::Glyph* glyph = find(*text);
+    if (glyph == NULL) {
+      continue;
+    }
+
+    const uint8_t* row = &FontSubset::BITMAP[glyph->offset];
+    uint8_t rowBytes = (glyph->width + 7) / 8;
+    for (int32_t r = 0; r < FontSubset::HEIGHT; r++, row += rowBytes) {
+      // One fillRect per run of set pixels
+      int32_t c = 0;
+      while (c < glyph->width) {
+        if (!(row[c / 8] & (0x80 >> (c % 8)))) {
+          c++;
+          continue;
+        }
+        int32_t start = c;
+        while (c < glyph->width && (row[c / 8] & (0x80 >> (c % 8)))) {
+          c++;
+        }
+        sprite.fillRect(x + start * scale, y + r * scale, (c - start) * scale, scale, color);
+      }
+    }
+    x += glyph->advance * scale;
+  }
+  return x;
+}
@@ -0,0 +1,25 @@
+#ifndef SUBSET_FONT_H
+#define SUBSET_FONT_H
+
+#include <TFT_eSPI.h>
+#include "FontSubset.h"
+
+// Draws text with the generated glyph tables of FontSubset.h into a sprite.
+// Only the glyphs the firmware needs are linked, see tools/gen_font_subset.py.
+// Glyphs that are not in the subset are skipped.
+class SubsetFont {
+public:
+  // Width of the text in pixels
+  static int32_t textWidth(const char* text);
+
+  // Height of the text in pixels
+  static int32_t height() { return FontSubset::HEIGHT * FontSubset::SCALE; }
+
+  // Draw the text with its top left corner at x, y. Background is not touched
+  static int32_t drawString(TFT_eSprite& sprite, const char* text, int32_t x, int32_t y, uint32_t color);
+
+private:
+  static const FontSubset::Glyph* find(char code);
+};
+
+#endif // SUBSET_FONT_H
@@ -1,10 +1,28 @@
 #include <TFT_eSPI.h>
 #include <SPI.h>
 #include <time.h>
-#include <mutex>
+#include <sys/time.h>
 
+#include "config/TaskConfig.h"
 #include "wifi/WifiSmartConfig.h"
+#include "sntp/NetworkTime.h"
 #include "buttons/ButtonHandler.h"
+#include "state/SystemState.h"
+#include "clock/HandPosition.h"
+#include "clock/HandTracker.h"
+#include "clock/HandMover.h"
+#include "sleep/DeepSleepMode.h"
+#include "trace/Trace.h"
+#include "telemetry/Telemetry.h"
+#include "ota/DeltaOta.h"
+#include "display/SubsetFont.h"
+
+#ifdef SLAVECLOCK_LOAD_TEST
+#include "lwip/sockets.h"
+#endif
+#ifdef SLAVECLOCK_DEEP_SLEEP
+#include "nvs_flash.h"
+#endif
 
 #define TAG "SLAVECLOCK"
 
@@ -23,41 +41,142 @@
 #define BUTTON_START_PIN GPIO_NUM_35
 
 #define PULSE_WIDTH_MS    350  // Pulse duration in milliseconds
-#define PULSE_INTERVAL_MS 150  // Time between pulses
+#define PULSE_INTERVAL_MS 60   // Minimum time between pulses, the thermal model slows down long bursts
+#define PULSE_RAMP_MS     0    // Soft start of the pulse, 0 for none
+#define PULSE_KICK_MS     120  // Full power part of the pulse, the rest is hold
+#define PULSE_HOLD_DUTY   40   // Duty in percent after the kick
+#define PULSE_COIL_MA     100  // Coil current at full power, measure it for your clock
+#define PULSE_PWM_CHANNEL 2    // LEDC channel for the enable pin. Uses another timer than the backlight
 #define PULSE_GPIO_ENABLE GPIO_NUM_25 // Pin for Enable of LM293D
 #define PULSE_GPIO_INPUT1 GPIO_NUM_26 // Pin for Input1 of LM293D
 #define PULSE_GPIO_INPUT2 GPIO_NUM_27 // Pin for Input2 of LM293D
+#define PULSE_SUPPLY_V    24.0f // Supply voltage of the L293D motor side
+
+// Thermal model of L293D and coil. Estimates, tune them for your hardware. With these
+// values the former fixed rate of 350 ms pulses 150 ms apart stays below the limit
+#define THERMAL_RESISTANCE_KW  38.0f // K/W to ambient
+#define THERMAL_CAPACITANCE_JK 2.0f  // J/K
+#define THERMAL_LIMIT_K        40.0f // Maximum temperature rise above ambient
 
 #define PWM_CHANNEL 0    // PWM channel
 #define PWM_FREQ 100     // 100 Hz
 #define PWM_RESOLUTION 8 // 8 bits, 0-255 
 #define PWM_DUTY 5      // Brightness
 
+#define TFT_MUTEX_ID 1   // Id of tftMutex in the trace
+
+#define HEAP_TOLERANCE 4096 // Allowed heap fluctuation after boot, e.g. WiFi buffers
+#define HEAP_LOSS_CHECKS 5  // Consecutive minutes below the baseline that count as a leak
+
+#define MIN_VALID_TIME 1704067200 // 2024-01-01. Earlier system time means the RTC was reset
+
+// Deep sleep mode, only with -DSLAVECLOCK_DEEP_SLEEP
+#define DEEP_SLEEP_WAKE_AHEAD_MS   300 // Wake up before the minute boundary to compensate the boot time
+#define DEEP_SLEEP_SYNC_HOURS      6   // Full boot with WiFi and SNTP every 6 hours
+#define DEEP_SLEEP_SYNC_TIMEOUT_MS 60000
+#define DEEP_SLEEP_RETRY_S         600 // Sleep time if there is no valid time at all
+#define DEEP_SLEEP_TELEMETRY_TIMEOUT_MS 20000 // Wait for the telemetry of a full boot before sleeping
+
+
+// NTP servers, the DHCP gateway (local router) is queried as well
+const char* const ntpservers[] = { "pool.ntp.org", "time.cloudflare.com" };
+#define NTP_USE_GATEWAY      true
+#define NTP_SYNC_INTERVAL_MS (60 * 60 * 1000) // Sync every hour
+#define NTP_RETRY_MS         (60 * 1000)      // Retry after a minute if no server answered
+
+// Telemetry is published after every time sync. Test with a local broker, e.g. mosquitto
+#define TELEMETRY_BROKER_URI ""           // e.g. "mqtt://192.168.0.10:1883", empty keeps the records local
+#define TELEMETRY_INTERVAL_MIN 15         // Metric snapshot every 15 minutes
+
+// Delta OTA, build the delta with tools/mkdelta.py and serve it with tools/ota_standin.py
+#define OTA_DELTA_URL ""                  // e.g. "http://192.168.0.10:8000/firmware.delta", empty disables OTA
+#define OTA_CHECK_INTERVAL_MS (6 * 60 * 60 * 1000) // Look for a new delta every 6 hours
+#define OTA_RETRY_MS          (5 * 60 * 1000)      // Resume an interrupted download after 5 minutes
 
-const char* ntpserver  = "pool.ntp.org";
 const char* hostname   = "ESP32-Nebenuhr";
 const char* aes_key    = "ESP32-AES-PHRASE"; 
 
-TaskHandle_t moveHandsTaskHandle;
+TaskHandle_t timeKeeperTaskHandle;
 TaskHandle_t displayTimeTaskHandle;
-std::mutex tftMutex;
-
-bool timeSynced    = false; // Status of time-synchronisation
-WifiSmartConfig::WifiConnectStatus wifiConnected = WifiSmartConfig::WifiConnectStatus::Disconnected; // Status of WiFi connection
+TaskHandle_t networkTaskHandle;
+TaskHandle_t otaTaskHandle;
+StaticSemaphore_t tftMutexBuffer;
+SemaphoreHandle_t tftMutex;
+
+// Static stacks and control blocks of the tasks
+StackType_t timeKeeperTaskStack[TASK_TIME_STACK];
+StaticTask_t timeKeeperTaskBuffer;
+StackType_t displayTimeTaskStack[TASK_UI_STACK];
+StaticTask_t displayTimeTaskBuffer;
+StackType_t networkTaskStack[TASK_NETWORK_STACK];
+StaticTask_t networkTaskBuffer;
+StackType_t otaTaskStack[TASK_OTA_STACK];
+StaticTask_t otaTaskBuffer;
+#ifdef SLAVECLOCK_LOAD_TEST
+StackType_t loadDisplayTaskStack[TASK_LOAD_STACK];
+StaticTask_t loadDisplayTaskBuffer;
+StackType_t loadNetworkTaskStack[TASK_LOAD_STACK];
+StaticTask_t loadNetworkTaskBuffer;
+#endif
+
+size_t heapBaseline = 0; // Free heap once the network is up, see loop()
+volatile bool networkSettled = false; // First sync and telemetry window done, WiFi, lwIP and MQTT have allocated
+volatile bool otaRunning = false;     // DeltaOta downloads, the HTTP client holds its buffers
+
+SystemState systemState; // Status of WiFi connection, time-synchronisation and hands
+
+// Lateness of the minute pulses relative to the minute boundary
+struct PulseStats {
+  uint32_t count;
+  uint32_t maxLatenessMs;
+  uint64_t sumLatenessMs;
+};
+PulseStats pulseStats = {0, 0, 0};
+
+// Render time of the time display
+struct RenderStats {
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t sumUs;
+};
+RenderStats renderStats = {0, 0, 0};
 
 // Prototype for tasks
 void displayTimeTask(void *param);
-void moveHandsTask(void *param);
+void timeKeeperTask(void *param);
+void moveHands();
+void recordLateness(bool minuteStep);
+void networkTask(void *param);
+void otaTask(void *param);
+#ifdef SLAVECLOCK_LOAD_TEST
+void loadDisplayTask(void *param);
+void loadNetworkTask(void *param);
+#endif
 
 // Prototype for callbacks
 void connectionCallback(WifiSmartConfig::WifiConnectStatus status);
 void timeSyncCallback(struct timeval *tv);
+void stateCallback(const SystemState::Snapshot& state, void* context);
 
 
 // Init objects
 TFT_eSPI tft = TFT_eSPI();
+TFT_eSprite textSprite = TFT_eSprite(&tft); // 1 bit, digits of the generated font subset
 ButtonHandler buttons(BUTTON_MOVE_PIN, BUTTON_START_PIN);
-WifiSmartConfig wifi(aes_key, hostname, ntpserver, connectionCallback, timeSyncCallback);
+HandPosition handPosition(CLOCK_HOURS * 60);
+HandTracker handTracker(CLOCK_HOURS * 60);
+HandMover handMover(handPosition, PULSE_GPIO_ENABLE, PULSE_GPIO_INPUT1, PULSE_GPIO_INPUT2, PULSE_PWM_CHANNEL,
+                    { PULSE_RAMP_MS, PULSE_KICK_MS, PULSE_WIDTH_MS - PULSE_RAMP_MS - PULSE_KICK_MS,
+                      PULSE_HOLD_DUTY, PULSE_COIL_MA },
+                    PULSE_INTERVAL_MS);
+ThermalModel thermalModel({ THERMAL_RESISTANCE_KW, THERMAL_CAPACITANCE_JK, THERMAL_LIMIT_K });
+#ifdef SLAVECLOCK_DEEP_SLEEP
+DeepSleepMode deepSleep(DEEP_SLEEP_WAKE_AHEAD_MS, DEEP_SLEEP_SYNC_HOURS);
+#endif
+WifiSmartConfig wifi(aes_key, hostname, connectionCallback);
+NetworkTime networkTime(ntpservers, sizeof(ntpservers) / sizeof(ntpservers[0]), NTP_USE_GATEWAY, timeSyncCallback);
+Telemetry telemetry(TELEMETRY_BROKER_URI, hostname);
+DeltaOta deltaOta(OTA_DELTA_URL);
 
 
 
@@ -99,36 +218,74 @@ void printInfo() {
   Serial.println(" MB");
 }
 
-void updateDisplayStatus() {
+void lockDisplay() {
+  TRACE_EVENT(MutexWait, TFT_MUTEX_ID);
+  xSemaphoreTake(tftMutex, portMAX_DELAY);
+  TRACE_EVENT(MutexTake, TFT_MUTEX_ID);
+}
+
+void unlockDisplay() {
+  xSemaphoreGive(tftMutex);
+  TRACE_EVENT(MutexGive, TFT_MUTEX_ID);
+}
+
+void updateDisplayStatus(const SystemState::Snapshot& state) {
+  static uint32_t shownVersion = 0;
+
+  lockDisplay();
 
-  tftMutex.lock();
+  // Subscribers run in different tasks. Never overwrite a newer state
+  if (state.version < shownVersion) {
+    unlockDisplay();
+    return;
+  }
+  shownVersion = state.version;
 
-  if (wifiConnected == WifiSmartConfig::WifiConnectStatus::Disconnected) {
+  if (state.wifiStatus == WifiSmartConfig::WifiConnectStatus::Disconnected) {
     tft.fillRect(0, 0, tft.width() / 2 - 1, 20, RED);    // Red for no WiFi
-  } else if (wifiConnected == WifiSmartConfig::WifiConnectStatus::Smartconfig) {
+  } else if (state.wifiStatus == WifiSmartConfig::WifiConnectStatus::Smartconfig) {
     tft.fillRect(0, 0, tft.width() / 2 - 1, 20, ORANGE); // Orange for Smartconfig
-  } else if (wifiConnected == WifiSmartConfig::WifiConnectStatus::Connected) {
+  } else if (state.wifiStatus == WifiSmartConfig::WifiConnectStatus::Connected) {
     tft.fillRect(0, 0, tft.width() / 2 - 1, 20, GREEN);  // Green for connected
   }
 
-  if (timeSynced) {
+  if (state.timeSynced) {
     tft.fillRect(tft.width() / 2 + 1, 0, tft.width(), 20, GREEN);
+  } else if (state.timeValid) {
+    tft.fillRect(tft.width() / 2 + 1, 0, tft.width(), 20, ORANGE); // Orange for time from RTC
   } else {
     tft.fillRect(tft.width() / 2 + 1, 0, tft.width(), 20, RED);
   }
 
-  tftMutex.unlock(); 
+  unlockDisplay();
+}
+
+// Draw digits centered at x, y with the generated font subset. Call with the display locked
+// font-subset: 0123456789:
+void drawDigits(const char* text, int32_t x, int32_t y) {
+  int32_t width = SubsetFont::textWidth(text);
+
+  textSprite.fillSprite(0);
+  SubsetFont::drawString(textSprite, text, 0, 0, 1);
+  textSprite.pushSprite(x - width / 2, y - SubsetFont::height() / 2, 0, 0, width, SubsetFont::height());
 }
 
 void updateDisplayTime(const char* timeStr) {
 
-  tftMutex.lock();
+  lockDisplay();
 
   // Show the time on the display
-  tft.setTextDatum(MC_DATUM);
-  tft.drawString(timeStr, tft.width() / 2, tft.height() / 2, 4);
+  uint32_t start = micros();
+  drawDigits(timeStr, tft.width() / 2, tft.height() / 2);
+  uint32_t renderUs = micros() - start;
+
+  unlockDisplay();
 
-  tftMutex.unlock(); 
+  renderStats.count++;
+  renderStats.sumUs += renderUs;
+  if (renderUs > renderStats.maxUs) {
+    renderStats.maxUs = renderUs;
+  }
 }
 
 
@@ -146,51 +303,162 @@ bool getTime(struct tm& timeInfo) {
 void connectionCallback(WifiSmartConfig::WifiConnectStatus status) {
   ESP_LOGI(TAG, "Connection status: %d", status);
 
-  wifiConnected = status;
-  updateDisplayStatus();
+  systemState.setWifiStatus(status);
 }
 
 void timeSyncCallback(struct timeval *tv) {
   ESP_LOGI(TAG, "Zeit synchronisiert: %s", ctime(&tv->tv_sec));
 
-  timeSynced = true;
-  updateDisplayStatus();
+  systemState.setTimeSynced(true);
 }
 
-// Function to send multiple pulses with delays to LM293D
-void sendPulses(uint16_t count) {
-  ESP_LOGI(TAG, "Send pulses %d ", count);
+void stateCallback(const SystemState::Snapshot& state, void* context) {
+  ESP_LOGD(TAG, "State version %u", state.version);
 
-  static int level = 0;
+  // Drawing is done by the UI task, never in the event loop or SNTP context
+  if (displayTimeTaskHandle != NULL) {
+    xTaskNotifyGive(displayTimeTaskHandle);
+  } else {
+    updateDisplayStatus(state);
+  }
+}
 
-  for (uint16_t i = 0; i < count; i++) {
-    // direction of current
-    digitalWrite(PULSE_GPIO_INPUT1, level);
-    digitalWrite(PULSE_GPIO_INPUT2, !level);
+// Position picker for the setup: the operator steps the hands until they move with
+// every pulse, then enters the time they show. A slave movement ignores a pulse with
+// the wrong polarity, the stepping brings the stored polarity in line with the hands
+uint16_t pickerMinutes = 0; // Entered position on the dial
+uint8_t pickerField = 0;    // 0: step the hands, 1: hours, 2: minutes, 3: done
 
-    // Set the GPIO high to start the pulse
-    digitalWrite(PULSE_GPIO_ENABLE, HIGH);
-    vTaskDelay(pdMS_TO_TICKS(PULSE_WIDTH_MS));
-    
-    // Set the GPIO low to end the pulse
-    digitalWrite(PULSE_GPIO_ENABLE, LOW);
-    vTaskDelay(pdMS_TO_TICKS(PULSE_INTERVAL_MS));  
+void drawPicker() {
+  char text[6];
+  uint8_t hour = pickerMinutes / 60;
+  snprintf(text, sizeof(text), "%02u:%02u", (CLOCK_HOURS == 12 && hour == 0) ? 12 : hour, pickerMinutes % 60);
 
-    level = !level;
+  lockDisplay();
+
+  // Info text
+  tft.fillRect(0, 50, tft.width(), 16, TFT_BLACK);
+  tft.setCursor(0, 50);
+  tft.print(pickerField == 0 ? "Move: step hands" : "Hands show:");
+
+  int y = tft.height() - 35; // Below the info text
+  int digitsWidth = SubsetFont::textWidth("00");
+  int colonWidth = SubsetFont::textWidth(":");
+  int x = (tft.width() - 2 * digitsWidth - colonWidth) / 2;
+
+  tft.fillRect(0, y - 30, tft.width(), 66, TFT_BLACK);
+  drawDigits(text, tft.width() / 2, y);
+
+  // Underline the selected field
+  if (pickerField == 1 || pickerField == 2) {
+    int fieldX = pickerField == 1 ? x : x + digitsWidth + colonWidth;
+    tft.fillRect(fieldX, y + 28, digitsWidth, 4, ORANGE);
   }
+
+  unlockDisplay();
 }
 
-// Function to send one pulse
-void sendPulse() {
-  ESP_LOGI(TAG, "Move hand");
+// Move button: one pulse or increase the selected field, repeats with long press
+void pickerMove() {
+  uint8_t hour = pickerMinutes / 60;
+  uint8_t minute = pickerMinutes % 60;
 
-  sendPulses(1);
+  if (pickerField == 0) {
+    ESP_LOGI(TAG, "Move hand");
+    handMover.advance(1);
+    pickerMinutes = (pickerMinutes + 1) % (CLOCK_HOURS * 60);
+    drawPicker();
+    return;
+  }
+  if (pickerField == 1) {
+    hour = (hour + 1) % CLOCK_HOURS;
+  } else {
+    minute = (minute + 1) % 60;
+  }
+  pickerMinutes = hour * 60 + minute;
+  drawPicker();
+}
+
+// Start button: next field, ends the setup after the minutes
+bool pickerNext() {
+  pickerField++;
+  drawPicker();
+  return pickerField > 2;
 }
 
+#ifdef SLAVECLOCK_DEEP_SLEEP
+// Pulse callback of the wake path, called by the pulse task when the coil is energised
+void deepSleepPulse(bool minuteStep) {
+  if (minuteStep) {
+    deepSleep.recordPulse();
+  }
+}
+
+// Wake path of the deep sleep mode: one pulse, then sleep again. No WiFi or TFT,
+// NVS only after the pulse so it does not delay it
+void deepSleepWake() {
+  gpio_hold_dis(PULSE_GPIO_ENABLE);
+
+  deepSleep.restoreTimezone();
+  handPosition.setPersistent(false);
+  if (!handPosition.restore()) {
+    handPosition.setPersistent(true);
+    return; // Continue with a full boot
+  }
+  handMover.setPulseCallback(deepSleepPulse);
+  handMover.start();
+
+  deepSleep.waitForMinute();
+  moveHands();
+  handMover.waitIdle();
+
+  // RTC memory does not survive a power cut, keep NVS up to date before every sleep
+  if (nvs_flash_init() == ESP_OK) {
+    handPosition.setPersistent(true);
+    handPosition.commit();
+  } else {
+    ESP_LOGE(TAG, "NVS not available, position only in RTC memory");
+  }
+  deepSleep.sleepUntilNextMinute(PULSE_GPIO_ENABLE);
+}
+
+// Full boot of the deep sleep mode: sync the time, catch up the hands, then sleep
+void deepSleepRun() {
+  if (!systemState.waitFor(SystemState::TIME_VALID, pdMS_TO_TICKS(DEEP_SLEEP_SYNC_TIMEOUT_MS))) {
+    ESP_LOGW(TAG, "No valid time, sleep for %d s", DEEP_SLEEP_RETRY_S);
+    deepSleep.sleepFor(DEEP_SLEEP_RETRY_S, PULSE_GPIO_ENABLE);
+  }
+  if (!systemState.waitFor(SystemState::TIME_SYNCED, pdMS_TO_TICKS(DEEP_SLEEP_SYNC_TIMEOUT_MS))) {
+    ESP_LOGW(TAG, "No SNTP sync, continue with RTC time");
+  }
+  deepSleep.markSyncAttempt();
+
+  deepSleep.saveTimezone();
+  deepSleep.report();
+
+  moveHands();
+  handMover.waitIdle(); // The mover writes NVS before it reports idle
+
+  // The network task publishes after the sync, let it finish before the radio goes off
+  if (systemState.snapshot().wifiStatus == WifiSmartConfig::WifiConnectStatus::Connected &&
+      !telemetry.waitPublished(pdMS_TO_TICKS(DEEP_SLEEP_TELEMETRY_TIMEOUT_MS))) {
+    ESP_LOGW(TAG, "Telemetry kept for the next full boot, %u records", telemetry.pending());
+  }
+  deepSleep.sleepUntilNextMinute(PULSE_GPIO_ENABLE);
+}
+#endif
+
 void setup(void) {
 
   setCpuFrequencyMhz(80);
 
+#ifdef SLAVECLOCK_DEEP_SLEEP
+  if (deepSleep.isTimerWake() && !deepSleep.syncDue()) {
+    deepSleepWake(); // Returns only if a full boot is needed
+  }
+  gpio_hold_dis(PULSE_GPIO_ENABLE);
+#endif
+
   Serial.begin(115200);
   while (!Serial){
     delay(500);
@@ -201,11 +469,23 @@ void setup(void) {
 
   printInfo();
 
-  // Init pins
-  pinMode(PULSE_GPIO_ENABLE, OUTPUT);
-  pinMode(PULSE_GPIO_INPUT1, OUTPUT);
-  pinMode(PULSE_GPIO_INPUT2, OUTPUT);
-  digitalWrite(PULSE_GPIO_ENABLE, LOW);
+  TRACE_INIT();
+
+  telemetry.init();
+  telemetry.record(Telemetry::Type::Boot, reason);
+
+  systemState.init();
+  tftMutex = xSemaphoreCreateMutexStatic(&tftMutexBuffer);
+
+  // Init pins and start the pulse task
+  handMover.setThermalModel(&thermalModel, PULSE_SUPPLY_V);
+  handMover.setPulseCallback(recordLateness);
+  handMover.start();
+
+  // Hands slightly ahead wait for the time instead of going round the dial
+  uint32_t turnPulseMs = handMover.pulsePeriodMs(CLOCK_HOURS * 60 - 1);
+  ESP_LOGI(TAG, "Full turn %u s, hands up to %u min ahead wait", turnPulseMs * (CLOCK_HOURS * 60 - 1) / 1000,
+           handTracker.maxHoldMinutes(turnPulseMs));
 
 
   // Init display
@@ -217,42 +497,54 @@ void setup(void) {
   tft.setTextSize(2);
 
 
+  // Sprite for the time digits, allocated once at boot
+  textSprite.setColorDepth(1);
+  textSprite.createSprite(SubsetFont::textWidth("00:00:00"), SubsetFont::height());
+  textSprite.setBitmapColor(TFT_WHITE, TFT_BLACK);
+
   // Set display brightness very low to save energy
   ledcSetup(PWM_CHANNEL, PWM_FREQ, PWM_RESOLUTION);
   ledcAttachPin(TFT_BL, PWM_CHANNEL);
   ledcWrite(PWM_CHANNEL, PWM_DUTY);
 
   // Init status display
-  updateDisplayStatus();
+  updateDisplayStatus(systemState.snapshot());
+  systemState.subscribe(stateCallback);
 
-  // Start Wifi 
-  tft.setCursor(0, 30);
-  tft.print("Waiting for WiFi");
-
-  if (wifi.init() == ESP_OK) {
+  // Init WiFi and NVS. Connecting is done in the background by the network task
+  bool wifiReady = wifi.init() == ESP_OK;
+  if (wifiReady) {
      ESP_LOGI(TAG, "WiFi initialisiert");
   } else {
      ESP_LOGE(TAG, "WiFi Initialisierung fehlgeschlagen");
-    return;
-  }
-
-  while (wifi.connect() != ESP_OK) {
-     ESP_LOGE(TAG, "WiFi Verbindung fehlgeschlagen. Erneuter Versuch...");
-  }
-
-  // SNTP und Zeitzone initialisieren
-  if (wifi.initSNTP() == ESP_OK) {
-     ESP_LOGI(TAG, "SNTP initialisiert");
-  } else {
-     ESP_LOGE(TAG, "SNTP Initialisierung fehlgeschlagen");
   }
 
+  // Timezone from the last SmartConfig, so the local time is right before the first sync
   if (wifi.initTimezone() == ESP_OK) {
      ESP_LOGI(TAG, "Zeitzone initialisiert");
   } else {
      ESP_LOGE(TAG, "Zeitzonen Initialisierung fehlgeschlagen");
   }
 
+  // The RTC keeps the system time over software resets, watchdog resets and deep sleep
+  time_t now = time(NULL);
+  if (now > MIN_VALID_TIME) {
+    ESP_LOGI(TAG, "Time retained by RTC: %s", ctime(&now));
+    systemState.setTimeValid(true);
+  }
+
+  if (wifiReady) {
+    networkTaskHandle = xTaskCreateStaticPinnedToCore(networkTask, TASK_NETWORK_NAME, TASK_NETWORK_STACK, NULL,
+                          TASK_NETWORK_PRIORITY, networkTaskStack, &networkTaskBuffer, TASK_NETWORK_CORE);
+#ifndef SLAVECLOCK_DEEP_SLEEP
+    // Not in deep sleep mode, the network window is too short for an update
+    if (OTA_DELTA_URL[0] != '\0' && deltaOta.begin() == ESP_OK) {
+      otaTaskHandle = xTaskCreateStaticPinnedToCore(otaTask, TASK_OTA_NAME, TASK_OTA_STACK, NULL,
+                        TASK_OTA_PRIORITY, otaTaskStack, &otaTaskBuffer, TASK_OTA_CORE);
+    }
+#endif
+  }
+
 
   const char* reset_reason_str;
   switch (reason) {
@@ -269,71 +561,211 @@ void setup(void) {
       default: reset_reason_str = "Unknown Reset"; break;
   }
 
+  // The network task may already draw the status
+  lockDisplay();
   tft.fillRect(0, 30, tft.width(), tft.height(), TFT_BLACK); 
   tft.setCursor(0, 30);
   tft.print(reset_reason_str);
-
-  // Info text
-  tft.setCursor(0, 50);
-  tft.print("Move the hands to 12 o'clock position. Then press Start");
-  
-  ESP_LOGI(TAG, "Start Setup");
-  buttons.setMoveCallback(sendPulse); // Callback for moving the handles
-  buttons.start(); // Blocking loop to set the hands
+  unlockDisplay();
+
+  // Setup if the position of the hands is unknown or Start is held at boot.
+  // The operator steps the hands and enters the time they show, the time keeper does the rest
+  bool setupRequested = digitalRead(BUTTON_START_PIN) == LOW;
+  if (!handPosition.restore() || setupRequested) {
+    ESP_LOGI(TAG, "Start Setup");
+    while (digitalRead(BUTTON_START_PIN) == LOW) {
+      delay(10); // Wait until Start is released
+    }
+    pickerMinutes = handPosition.minutes();
+    pickerField = 0;
+    drawPicker();
+
+    buttons.setMoveCallback(pickerMove);
+    buttons.setStartCallback(pickerNext);
+    buttons.start(); // Blocking loop to step the hands and enter the position
+
+    // Send the steps first, setPosition() drops a backlog. The polarity of the last step stays
+    ESP_LOGI(TAG, "Hands at %u", pickerMinutes);
+    handMover.waitIdle();
+    handMover.setPosition(pickerMinutes);
+    handMover.waitIdle();
+  }
+  systemState.setPositionKnown(true);
   
 
+  lockDisplay();
   tft.fillRect(0, 30, tft.width(), tft.height(), TFT_BLACK);    
+  unlockDisplay();
+
+#ifdef SLAVECLOCK_DEEP_SLEEP
+  deepSleepRun(); // Does not return
+#endif
+
+  // Create tasks, see config/TaskConfig.h
+  displayTimeTaskHandle = xTaskCreateStaticPinnedToCore(displayTimeTask, TASK_UI_NAME, TASK_UI_STACK, NULL, 
+                          TASK_UI_PRIORITY, displayTimeTaskStack, &displayTimeTaskBuffer, TASK_UI_CORE);
+  timeKeeperTaskHandle = xTaskCreateStaticPinnedToCore(timeKeeperTask, TASK_TIME_NAME, TASK_TIME_STACK, NULL, 
+                          TASK_TIME_PRIORITY, timeKeeperTaskStack, &timeKeeperTaskBuffer, TASK_TIME_CORE); 
+
+#ifdef SLAVECLOCK_LOAD_TEST
+  ESP_LOGW(TAG, "Load test enabled");
+  xTaskCreateStaticPinnedToCore(loadDisplayTask, "LoadDisplay", TASK_LOAD_STACK, NULL,
+                          TASK_LOAD_DISPLAY_PRIORITY, loadDisplayTaskStack, &loadDisplayTaskBuffer, TASK_LOAD_DISPLAY_CORE);
+  xTaskCreateStaticPinnedToCore(loadNetworkTask, "LoadNetwork", TASK_LOAD_STACK, NULL,
+                          TASK_LOAD_NETWORK_PRIORITY, loadNetworkTaskStack, &loadNetworkTaskBuffer, TASK_LOAD_NETWORK_CORE);
+#endif
 
-  // Create task
-  xTaskCreatePinnedToCore(displayTimeTask, "DisplayTime", 8192, NULL, 1, &displayTimeTaskHandle, 1);
-  xTaskCreatePinnedToCore(moveHandsTask, "MoveHands", 8192, NULL, 1, &moveHandsTaskHandle, 1); 
+}
 
+// Milliseconds until the next full minute, at most one second
+uint32_t msToNextMinute() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  uint32_t ms = (59 - tv.tv_sec % 60) * 1000 + (999 - tv.tv_usec / 1000) + 1;
+  return ms < 1000 ? ms : 1000;
 }
 
-// Task to move the hands
-void moveHandsTask(void *param) {
+// Record how late the pulse for the current minute starts
+// Called by the pulse task when the coil is energised
+void recordLateness(bool minuteStep) {
+  if (!minuteStep) {
+    return; // Catch-up pulses are late on purpose
+  }
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  uint32_t lateness = (tv.tv_sec % 60) * 1000 + tv.tv_usec / 1000;
+
+  pulseStats.count++;
+  pulseStats.sumLatenessMs += lateness;
+  if (lateness > pulseStats.maxLatenessMs) {
+    pulseStats.maxLatenessMs = lateness;
+  }
+}
+
+bool correcting = false; // A catch-up or hold is running, see moveHands()
+
+// Move the hands to the current time
+void moveHands() {
   struct tm timeinfo;
 
-  // Wait until we get the correct time
-  do {
-    vTaskDelay(pdMS_TO_TICKS(1000));
-  } while (!timeSynced);
+  if (getTime(timeinfo)) { // Get the current time
 
-  // Now start movement of the hands
-  while (true) {
-    
-    if (getTime(timeinfo)) { // Get the current time
+    // Error of the hands as they stand now, for the statistics
+    HandMover::Status status = handMover.status();
+    handTracker.observe(handTracker.difference(status.position, timeinfo), millis());
 
-      static int16_t clock_minutes = 0; // Variable to track the clock's current minute position
-      uint16_t current_minutes = (timeinfo.tm_hour % CLOCK_HOURS) * 60 + timeinfo.tm_min;  // Calculate current minutes on the clock
-      int16_t difference = current_minutes - clock_minutes; // Calculate the difference in minutes
+    // Difference between the clock's position, including pulses still to be sent, and the time
+    uint16_t position = (status.position + status.backlog) % (CLOCK_HOURS * 60);
+    uint16_t difference = handTracker.difference(position, timeinfo);
 
-      ESP_LOGI(TAG, "Difference: %d", difference);
+    ESP_LOGI(TAG, "Difference: %d", difference);
+    uint16_t forward = difference;
 
-      // Handle negative differences (e.g., crossing midnight or wrapping around the 12-hour format)
-      if (difference < 0) {
-          difference += CLOCK_HOURS * 60; // Add hours in minutes. Time always goes forward :-)
-      }
+    // Hands a little ahead: hold until the time has caught up. Going round
+    // takes as long as the thermal model lets the burst run
+    uint32_t pulseMs = forward > 1 ? handMover.pulsePeriodMs(forward) : PULSE_WIDTH_MS + PULSE_INTERVAL_MS;
+    difference = handTracker.plan(position, timeinfo, pulseMs);
 
-      // Update clock_minutes to the current position after calculation
-      if (difference != 0) {
-        clock_minutes = current_minutes;
-        
-        // Move hands
-        sendPulses(difference);
+    // The pulses are sent by the pulse task of handMover
+    if (difference != 0) {
+      // Move hands
+      if (handMover.advance(difference)) {
+        handTracker.recordPulses(difference, PULSE_WIDTH_MS);
       }
     }
+    // One record per correction: when a catch-up or hold starts
+    if (forward > 1 && !correcting) {
+      telemetry.record(Telemetry::Type::Drift, forward, difference);
+    }
+    correcting = forward > 1;
+  }
+}
 
-    vTaskDelay(pdMS_TO_TICKS(1000)); 
+// Task to keep the hands in line with the time
+void timeKeeperTask(void *param) {
+
+  // Wait until we have a valid time and know where the hands are
+  systemState.waitFor(SystemState::TIME_VALID | SystemState::POSITION_KNOWN);
+  ESP_LOGI(TAG, "Time valid after %u ms", millis());
+
+  // Now start movement of the hands
+  while (true) {
+
+    moveHands();
+
+    // Poll every second, but wake up exactly at the minute boundary
+    vTaskDelay(pdMS_TO_TICKS(msToNextMinute())); 
 
   }
 
 }
 
-// Task: Show time on the display
+// Task: Connect to WiFi and sync the time without blocking the clock
+void networkTask(void *param) {
+  uint32_t start = millis();
+
+  while (wifi.connect() != ESP_OK) {
+     ESP_LOGE(TAG, "WiFi Verbindung fehlgeschlagen. Erneuter Versuch...");
+  }
+  const WifiSmartConfig::ConnectResult& connected = wifi.lastConnect();
+  ESP_LOGI(TAG, "WiFi connected via %s after %u ms, last attempt %u ms, %u SmartConfig windows",
+           connected.path == WifiSmartConfig::ConnectPath::Stored ? "stored AP" : "SmartConfig",
+           millis() - start, connected.ms, connected.windows);
+
+  // Zeitzone initialisieren. SmartConfig may have delivered a new timezone
+  if (wifi.initTimezone() == ESP_OK) {
+     ESP_LOGI(TAG, "Zeitzone initialisiert");
+  } else {
+     ESP_LOGE(TAG, "Zeitzonen Initialisierung fehlgeschlagen");
+  }
+
+  // Sync the time periodically. WifiSmartConfig reconnects by itself
+  while (true) {
+    systemState.waitFor(SystemState::WIFI_CONNECTED);
+
+    NetworkTime::SyncResult result;
+    esp_err_t err = networkTime.sync(result);
+    if (err == ESP_OK) {
+      int64_t offsetMs = constrain(result.offsetUs / 1000, (int64_t)INT32_MIN, (int64_t)INT32_MAX);
+      telemetry.record(Telemetry::Type::Sync, min(result.delayUs / 1000, (uint32_t)UINT16_MAX), offsetMs);
+    } else {
+      ESP_LOGE(TAG, "Zeitsynchronisation fehlgeschlagen");
+    }
+
+    // Send the telemetry while the network is up anyway
+    if (telemetry.publish() != ESP_OK) {
+      ESP_LOGW(TAG, "Telemetry kept for the next sync, %u records", telemetry.pending());
+    }
+    networkSettled = true;
+    vTaskDelay(pdMS_TO_TICKS(err == ESP_OK ? NTP_SYNC_INTERVAL_MS : NTP_RETRY_MS));
+  }
+}
+
+// Task: Look for a delta update and apply it. The pulse task keeps running meanwhile
+void otaTask(void *param) {
+  while (true) {
+    systemState.waitFor(SystemState::WIFI_CONNECTED);
+
+    otaRunning = true;
+    esp_err_t err = deltaOta.update();
+    otaRunning = false;
+    if (err == ESP_OK) {
+      // Boot the new firmware between two pulses, the position is kept in RTC memory
+      handMover.waitIdle();
+      ESP_LOGI(TAG, "Neustart mit neuer Firmware");
+      esp_restart();
+    }
+    vTaskDelay(pdMS_TO_TICKS(err == ESP_ERR_NOT_FOUND ? OTA_CHECK_INTERVAL_MS : OTA_RETRY_MS));
+  }
+}
+
+// Task: Show time and status on the display
 void displayTimeTask(void *param) {
   struct tm timeinfo;
 
+  updateDisplayStatus(systemState.snapshot());
+
   while (true) {
     // Get the current time
     if (getTime(timeinfo)) {
@@ -345,24 +777,187 @@ void displayTimeTask(void *param) {
       updateDisplayTime(timeStr);
     }
 
-    vTaskDelay(pdMS_TO_TICKS(1000)); // Wait a second
+    // Wait a second. Redraw the status immediately when the state changes
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000)) > 0) {
+      updateDisplayStatus(systemState.snapshot());
+    }
+  }
+}
+
+#ifdef SLAVECLOCK_LOAD_TEST
+// Load test: Keep the SPI bus and tftMutex busy with full screen redraws
+void loadDisplayTask(void *param) {
+  uint16_t color = 0;
+
+  while (true) {
+    lockDisplay();
+    tft.fillRect(0, 30, tft.width(), tft.height() - 30, color);
+    unlockDisplay();
+    color += 0x0821;
+    vTaskDelay(1);
+  }
+}
+
+// Load test: Saturate the WiFi with UDP broadcasts to the discard port
+void loadNetworkTask(void *param) {
+  static uint8_t payload[1024];
+
+  systemState.waitFor(SystemState::WIFI_CONNECTED);
+
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  int broadcast = 1;
+  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(9);
+  addr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+
+  while (true) {
+    for (int i = 0; i < 10; i++) {
+      sendto(sock, payload, sizeof(payload), 0, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    vTaskDelay(1);
+  }
+}
+#endif
+
+// Log stack and heap usage once a minute
+// Lowest stack high water mark of the tasks, in bytes
+UBaseType_t lowestHighWaterMark() {
+  TaskHandle_t tasks[] = { timeKeeperTaskHandle, handMover.taskHandle(), displayTimeTaskHandle, networkTaskHandle,
+                           otaTaskHandle };
+  UBaseType_t lowest = UINT16_MAX;
+
+  for (TaskHandle_t task : tasks) {
+    if (task != NULL) {
+      lowest = min(lowest, uxTaskGetStackHighWaterMark(task));
+    }
+  }
+  return lowest;
+}
+
+// Log the stack use of every task, see config/TaskConfig.h. tools/stack_sizes.py
+// turns these lines into stack sizes
+void checkStacks() {
+  struct TaskStack {
+    const char* name;
+    TaskHandle_t task;
+    uint32_t size;
+  };
+  TaskStack stacks[] = {
+    { TASK_PULSE_NAME, handMover.taskHandle(), TASK_PULSE_STACK },
+    { TASK_TIME_NAME, timeKeeperTaskHandle, TASK_TIME_STACK },
+    { TASK_UI_NAME, displayTimeTaskHandle, TASK_UI_STACK },
+    { TASK_NETWORK_NAME, networkTaskHandle, TASK_NETWORK_STACK },
+    { TASK_OTA_NAME, otaTaskHandle, TASK_OTA_STACK },
+  };
+
+  for (const TaskStack& stack : stacks) {
+    if (stack.task == NULL) {
+      continue;
+    }
+    UBaseType_t highWaterMark = uxTaskGetStackHighWaterMark(stack.task);
+    ESP_LOGI(TAG, "Stack %s: %u of %u bytes used", stack.name, stack.size - highWaterMark, stack.size);
+    if (highWaterMark < TASK_STACK_HEADROOM) {
+      ESP_LOGE(TAG, "Stack %s: only %u bytes left, headroom %u bytes", stack.name, highWaterMark,
+               TASK_STACK_HEADROOM);
+#ifdef SLAVECLOCK_LOAD_TEST
+      abort(); // Fails the load test
+#endif
+    }
   }
 }
 
-// Not needed
+void recordMetrics(const HandMover::Status& moverStatus, size_t largestFreeBlock, size_t freeHeap) {
+  telemetry.record(Telemetry::Type::Pulses, min(pulseStats.maxLatenessMs, (uint32_t)UINT16_MAX), moverStatus.pulses);
+  telemetry.record(Telemetry::Type::Heap, largestFreeBlock / 1024, freeHeap);
+  telemetry.record(Telemetry::Type::Stack, lowestHighWaterMark());
+}
+
 void loop() {
 
-  if (moveHandsTaskHandle != NULL) {
-    UBaseType_t highWaterMark = uxTaskGetStackHighWaterMark(moveHandsTaskHandle);
-    ESP_LOGI(TAG, "MoveHandsTask High Water Mark: %u", highWaterMark);
+#ifdef SLAVECLOCK_TRACE
+  // Dump the trace buffer on request
+  while (Serial.available()) {
+    if (Serial.read() == 't') {
+      Trace::dump(Serial);
+    }
   }
-  if (displayTimeTaskHandle != NULL) {
-    UBaseType_t highWaterMark = uxTaskGetStackHighWaterMark(displayTimeTaskHandle);
-    ESP_LOGI(TAG, "DisplayTimeTask High Water Mark: %u", highWaterMark);
+
+  static uint8_t seconds = 0;
+  vTaskDelay(pdMS_TO_TICKS(1000));
+  if (++seconds < 60) {
+    return;
+  }
+  seconds = 0;
+#endif
+
+  checkStacks();
+  HandMover::Status moverStatus = handMover.status();
+  ESP_LOGI(TAG, "Hands at %u, backlog %u", moverStatus.position, moverStatus.backlog);
+  if (moverStatus.pulses > 0) {
+    ESP_LOGI(TAG, "Coil charge: %u mC total, %u uC per pulse", moverStatus.chargeMc,
+             (uint32_t)((uint64_t)moverStatus.chargeMc * 1000 / moverStatus.pulses));
+    ESP_LOGI(TAG, "Thermal: %.1f K, peak %.1f K, throttled %u ms", moverStatus.temperatureK,
+             moverStatus.peakK, moverStatus.throttleMs);
+  }
+  if (pulseStats.count > 0) {
+    ESP_LOGI(TAG, "Pulse lateness: max %u ms, avg %u ms, %u pulses", pulseStats.maxLatenessMs,
+             (uint32_t)(pulseStats.sumLatenessMs / pulseStats.count), pulseStats.count);
   }
+  if (renderStats.count > 0) {
+    ESP_LOGI(TAG, "Time render: max %u us, avg %u us", renderStats.maxUs,
+             (uint32_t)(renderStats.sumUs / renderStats.count));
+  }
+  const NetworkTime::SyncResult& sync = networkTime.lastResult();
+  if (sync.samples > 0) {
+    ESP_LOGI(TAG, "Last sync: %s, offset %lld us, delay %u us", sync.server, sync.offsetUs, sync.delayUs);
+  }
+  const HandTracker::Stats& handStats = handTracker.stats();
+  ESP_LOGI(TAG, "Hands: %u pulses, coil on %u s, max error %u min, %u corrections, time to correct max %u ms, last %u ms",
+           handStats.pulses, handStats.coilOnMs / 1000, handStats.maxErrorMinutes, handStats.corrections,
+           handStats.maxCorrectMs, handStats.lastCorrectMs);
   size_t largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
   ESP_LOGI(TAG, "Largest free block: %u bytes", largest_free_block);
 
+  // Steady state must be heap-free. The baseline is taken after the first network
+  // window, when WiFi, lwIP, SNTP and MQTT have their buffers. A loss that lasts
+  // HEAP_LOSS_CHECKS minutes is a leak, not a buffer in flight. The OTA window is skipped
+  size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  static uint8_t heapLossChecks = 0;
+  if (heapBaseline == 0) {
+    if (networkSettled && !otaRunning) {
+      heapBaseline = free_heap;
+      ESP_LOGI(TAG, "Heap baseline: %u bytes free", heapBaseline);
+    }
+  } else if (otaRunning) {
+    // The HTTP client of DeltaOta holds its buffers until the update is done
+  } else if (free_heap + HEAP_TOLERANCE < heapBaseline) {
+    if (heapLossChecks < HEAP_LOSS_CHECKS) {
+      heapLossChecks++;
+    }
+    if (heapLossChecks < HEAP_LOSS_CHECKS) {
+      ESP_LOGW(TAG, "Heap below baseline: %u bytes free, baseline %u bytes", free_heap, heapBaseline);
+    } else {
+      ESP_LOGE(TAG, "Heap leak: %u bytes free, baseline %u bytes", free_heap, heapBaseline);
+#ifdef SLAVECLOCK_LOAD_TEST
+      abort(); // Fails the load test
+#endif
+    }
+  } else {
+    heapLossChecks = 0;
+  }
+
+  // Metric snapshot for the telemetry
+  static uint16_t telemetryMinutes = 0;
+  if (++telemetryMinutes >= TELEMETRY_INTERVAL_MIN) {
+    telemetryMinutes = 0;
+    recordMetrics(moverStatus, largest_free_block, free_heap);
+  }
+
+#ifndef SLAVECLOCK_TRACE
   vTaskDelay(pdMS_TO_TICKS(60000));
+#endif
 
 }
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "DeltaOta.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "mbedtls/sha256.h"
+#include "nvs_flash.h"
+
+const char* DeltaOta::TAG = "delta_ota";
+const char* DeltaOta::NVS_NAMESPACE = "OTA";
+const char* DeltaOta::TARGET_VALUE = "TARGET";
+const char* DeltaOta::SECTOR_VALUE = "SECTOR";
+const char* DeltaOta::OFFSET_VALUE = "OFFSET";
+
+DeltaOta::DeltaOta(const char* url)
+  : _url(url), _running(NULL), _target(NULL), _baseSize(0), _buffers(NULL) {
+
+}
+
+esp_err_t DeltaOta::begin() {
+  if (_buffers != NULL) {
+    return ESP_OK;
+  }
+  _buffers = static_cast<Buffers*>(malloc(sizeof(Buffers)));
+  if (_buffers == NULL) {
+    ESP_LOGE(TAG, "No memory for %u bytes of buffers", sizeof(Buffers));
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t DeltaOta::update() {
+  if (_buffers == NULL) {
+    return ESP_ERR_INVALID_STATE; // begin() failed or was not called
+  }
+  _running = esp_ota_get_running_partition();
+  _target = esp_ota_get_next_update_partition(NULL);
+  if (_target == NULL) {
+    ESP_LOGE(TAG, "No OTA partition");
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  esp_http_client_handle_t client;
+  esp_err_t err = open(0, client);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  Header header;
+  err = read(client, (uint8_t*)&header, sizeof(header));
+  if (err == ESP_OK && (header.magic != MAGIC || header.sectorSize != SECTOR_SIZE)) {
+    ESP_LOGE(TAG, "Not a delta file");
+    err = ESP_ERR_INVALID_VERSION;
+  }
+  if (err == ESP_OK && (header.baseSize > _running->size || header.targetSize > _target->size)) {
+    ESP_LOGE(TAG, "Image too large for the partition");
+    err = ESP_ERR_INVALID_SIZE;
+  }
+
+  // The delta must be built against the running image. Hash it only once per boot
+  if (err == ESP_OK && _baseSize != header.baseSize) {
+    err = hash(_running, header.baseSize, _baseSha);
+    _baseSize = err == ESP_OK ? header.baseSize : 0;
+  }
+  if (err == ESP_OK && memcmp(_baseSha, header.baseSha, sizeof(_baseSha)) != 0) {
+    ESP_LOGI(TAG, "No delta for the running image");
+    err = ESP_ERR_NOT_FOUND;
+  }
+  if (err != ESP_OK) {
+    esp_http_client_cleanup(client);
+    return err;
+  }
+
+  // Resume an interrupted download
+  uint32_t sectors = (header.targetSize + SECTOR_SIZE - 1) / SECTOR_SIZE;
+  uint32_t sector = 0;
+  uint32_t offset = sizeof(Header);
+  if (loadProgress(header, sector, offset) && sector < sectors) {
+    ESP_LOGI(TAG, "Resume at sector %u", sector);
+    esp_http_client_cleanup(client);
+    err = open(offset, client);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  uint32_t start = millis();
+  while (sector < sectors) {
+    uint32_t length;
+    err = read(client, (uint8_t*)&length, sizeof(length));
+    if (err == ESP_OK) {
+      err = length <= BLOCK_MAX ? read(client, _buffers->block, length) : ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK) {
+      err = applyBlock(length, sector, header);
+    }
+    if (err != ESP_OK) {
+      break;
+    }
+
+    sector++;
+    offset += sizeof(length) + length;
+    if (sector % PROGRESS_SECTORS == 0) {
+      saveProgress(header, sector, offset);
+    }
+  }
+  esp_http_client_cleanup(client);
+
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Stopped at sector %u of %u: %s", sector, sectors, esp_err_to_name(err));
+    saveProgress(header, sector, offset);
+    return err;
+  }
+  ESP_LOGI(TAG, "%u sectors written in %u ms", sectors, millis() - start);
+
+  // Check the result before booting it. On a mismatch the next update starts over
+  uint8_t sha[32];
+  clearProgress();
+  err = hash(_target, header.targetSize, sha);
+  if (err == ESP_OK && memcmp(sha, header.targetSha, sizeof(sha)) != 0) {
+    ESP_LOGE(TAG, "SHA-256 of the new image does not match");
+    err = ESP_ERR_INVALID_CRC;
+  }
+  if (err == ESP_OK) {
+    err = esp_ota_set_boot_partition(_target);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Update failed: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  ESP_LOGI(TAG, "Boot partition is now %s", _target->label);
+  return ESP_OK;
+}
+
+esp_err_t DeltaOta::open(uint32_t offset, esp_http_client_handle_t& client) {
+  esp_http_client_config_t config = {};
+  config.url = _url;
+  config.timeout_ms = TIMEOUT_MS;
+
+  client = esp_http_client_init(&config);
+  if (client == NULL) {
+    return ESP_FAIL;
+  }
+
+  char range[24];
+  snprintf(range, sizeof(range), "bytes=%u-", offset);
+  esp_http_client_set_header(client, "Range", range);
+
+  esp_err_t err = esp_http_client_open(client, 0);
+  if (err == ESP_OK) {
+    esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+
+    // A server without Range support sends the whole file, fine only from the start
+    if (status == 404) {
+      err = ESP_ERR_NOT_FOUND;
+    } else if (status != 206 && !(status == 200 && offset == 0)) {
+      ESP_LOGW(TAG, "HTTP status %d", status);
+      err = ESP_ERR_INVALID_RESPONSE;
+    }
+  } else {
+    ESP_LOGW(TAG, "Failed to connect to %s", _url);
+  }
+
+  if (err != ESP_OK) {
+    esp_http_client_cleanup(client);
+    client = NULL;
+  }
+  return err;
+}
+
+esp_err_t DeltaOta::read(esp_http_client_handle_t client, uint8_t* buffer, size_t length) {
+  size_t done = 0;
+
+  while (done < length) {
+    int count = esp_http_client_read(client, (char*)buffer + done, length - done);
+    if (count <= 0) {
+      return ESP_ERR_TIMEOUT; // Connection lost or closed early
+    }
+    done += count;
+  }
+  return ESP_OK;
+}
+
+esp_err_t DeltaOta::applyBlock(uint32_t length, uint32_t sector, const Header& header) {
+  Buffers& buffers = *_buffers;
+  uint32_t address = sector * SECTOR_SIZE;
+  uint32_t sectorLength = header.targetSize - address < SECTOR_SIZE ? header.targetSize - address : SECTOR_SIZE;
+
+  // The whole block fits into the output buffer, so no dictionary is needed
+  tinfl_init(&buffers.inflator);
+  size_t inSize = length;
+  size_t outSize = OPS_MAX;
+  tinfl_status status = tinfl_decompress(&buffers.inflator, buffers.block, &inSize, buffers.ops, buffers.ops,
+                                         &outSize,
+                                         TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+  if (status != TINFL_STATUS_DONE) {
+    ESP_LOGE(TAG, "Block %u corrupt", sector);
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  // Build the sector from copies of the running image and inserted data
+  size_t filled = 0;
+  size_t i = 0;
+  while (i < outSize) {
+    uint16_t count;
+    if (buffers.ops[i] == OP_COPY && i + 7 <= outSize) {
+      uint32_t source;
+      memcpy(&source, &buffers.ops[i + 1], sizeof(source));
+      memcpy(&count, &buffers.ops[i + 5], sizeof(count));
+      if (source + count > header.baseSize || filled + count > sectorLength) {
+        break;
+      }
+      esp_err_t err = esp_partition_read(_running, source, &buffers.sector[filled], count);
+      if (err != ESP_OK) {
+        return err;
+      }
+      i += 7;
+    } else if (buffers.ops[i] == OP_INSERT && i + 3 <= outSize) {
+      memcpy(&count, &buffers.ops[i + 1], sizeof(count));
+      if (i + 3 + count > outSize || filled + count > sectorLength) {
+        break;
+      }
+      memcpy(&buffers.sector[filled], &buffers.ops[i + 3], count);
+      i += 3 + count;
+    } else {
+      break;
+    }
+    filled += count;
+  }
+  if (i != outSize || filled != sectorLength) {
+    ESP_LOGE(TAG, "Block %u invalid", sector);
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  // Stalls the flash cache of both cores for some ms, the LEDC keeps a running pulse going
+  esp_err_t err = esp_partition_erase_range(_target, address, SECTOR_SIZE);
+  if (err == ESP_OK) {
+    err = esp_partition_write(_target, address, buffers.sector, sectorLength);
+  }
+  return err;
+}
+
+esp_err_t DeltaOta::hash(const esp_partition_t* partition, uint32_t size, uint8_t sha[32]) {
+  mbedtls_sha256_context context;
+  esp_err_t err = ESP_OK;
+
+  mbedtls_sha256_init(&context);
+  mbedtls_sha256_starts_ret(&context, 0);
+  for (uint32_t offset = 0; offset < size && err == ESP_OK; offset += SECTOR_SIZE) {
+    uint32_t length = size - offset < SECTOR_SIZE ? size - offset : SECTOR_SIZE;
+    err = esp_partition_read(partition, offset, _buffers->sector, length);
+    if (err == ESP_OK) {
+      mbedtls_sha256_update_ret(&context, _buffers->sector, length);
+    }
+  }
+  mbedtls_sha256_finish_ret(&context, sha);
+  mbedtls_sha256_free(&context);
+  return err;
+}
+
+bool DeltaOta::loadProgress(const Header& header, uint32_t& sector, uint32_t& offset) {
+  nvs_handle_t handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return false;
+  }
+
+  // Only progress of the same target image counts
+  uint8_t target[32];
+  size_t size = sizeof(target);
+  bool found = nvs_get_blob(handle, TARGET_VALUE, target, &size) == ESP_OK && size == sizeof(target)
+               && memcmp(target, header.targetSha, sizeof(target)) == 0
+               && nvs_get_u32(handle, SECTOR_VALUE, &sector) == ESP_OK
+               && nvs_get_u32(handle, OFFSET_VALUE, &offset) == ESP_OK;
+  nvs_close(handle);
+
+  if (!found) {
+    sector = 0;
+    offset = sizeof(Header);
+  }
+  return found && sector > 0;
+}
+
+void DeltaOta::saveProgress(const Header& header, uint32_t sector, uint32_t offset) {
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open NVS %d", err);
+    return;
+  }
+  err = nvs_set_blob(handle, TARGET_VALUE, header.targetSha, sizeof(header.targetSha));
+  if (err == ESP_OK) {
+    err = nvs_set_u32(handle, SECTOR_VALUE, sector);
+  }
+  if (err == ESP_OK) {
+    err = nvs_set_u32(handle, OFFSET_VALUE, offset);
+  }
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to store progress %d", err);
+  }
+  nvs_close(handle);
+}
+
+void DeltaOta::clearProgress() {
+  nvs_handle_t handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+    nvs_erase_all(handle);
+    nvs_commit(handle);
+    nvs_close(handle);
+  }
+}
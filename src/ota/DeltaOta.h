@@ -0,0 +1,81 @@
+#ifndef DELTA_OTA_H
+#define DELTA_OTA_H
+
+#include <Arduino.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "esp_partition.h"
+#include "esp32/rom/miniz.h"
+
+// Delta OTA update. Downloads a delta against the running image built by
+// tools/mkdelta.py and patches it sector by sector into the inactive OTA
+// partition. Every sector is an independent deflated block, so RAM is bounded
+// by the buffers below, allocated once by begin() so a fragmented heap cannot
+// stop an update. An interrupted download resumes with an HTTP Range request at the sector stored in NVS.
+class DeltaOta {
+public:
+  // Constructor, url of the delta file, e.g. "http://192.168.0.10:8000/firmware.delta"
+  DeltaOta(const char* url);
+
+  // Allocate the buffers (about 28 KB) once, at boot and only if OTA is used
+  esp_err_t begin();
+
+  // Download and apply the delta and make the new image the boot partition.
+  // ESP_ERR_NOT_FOUND if there is no delta for the running image. Blocks for minutes.
+  // ESP_ERR_INVALID_STATE without begin()
+  esp_err_t update();
+
+private:
+  static const char* TAG;
+  static const char* NVS_NAMESPACE;
+  static const char* TARGET_VALUE;
+  static const char* SECTOR_VALUE;
+  static const char* OFFSET_VALUE;
+  static const uint32_t MAGIC = 0x31444353;  // "SCD1"
+  static const uint32_t SECTOR_SIZE = 4096;
+  static const size_t OPS_MAX = 6144;        // Inflated block, see tools/mkdelta.py
+  static const size_t BLOCK_MAX = 6400;      // Compressed block
+  static const uint32_t PROGRESS_SECTORS = 16; // Store the progress every 64 KB
+  static const int TIMEOUT_MS = 10000;
+
+  enum : uint8_t {
+    OP_COPY = 1,
+    OP_INSERT = 2
+  };
+
+  struct __attribute__((packed)) Header {
+    uint32_t magic;
+    uint32_t sectorSize;
+    uint32_t baseSize;
+    uint32_t targetSize;
+    uint8_t baseSha[32];
+    uint8_t targetSha[32];
+  };
+
+  const char* _url;
+  const esp_partition_t* _running;
+  const esp_partition_t* _target;
+  uint32_t _baseSize;       // Size _baseSha was computed for
+  uint8_t _baseSha[32];
+
+  // Buffers of update(), allocated once by begin()
+  struct Buffers {
+    tinfl_decompressor inflator;
+    uint8_t block[BLOCK_MAX];
+    uint8_t ops[OPS_MAX];
+    uint8_t sector[SECTOR_SIZE];
+  };
+  Buffers* _buffers;
+
+  esp_err_t open(uint32_t offset, esp_http_client_handle_t& client);
+  esp_err_t read(esp_http_client_handle_t client, uint8_t* buffer, size_t length);
+  esp_err_t readHeader(Header& header);
+  esp_err_t applyBlock(uint32_t length, uint32_t sector, const Header& header);
+  esp_err_t hash(const esp_partition_t* partition, uint32_t size, uint8_t sha[32]);
+
+  bool loadProgress(const Header& header, uint32_t& sector, uint32_t& offset);
+  void saveProgress(const Header& header, uint32_t sector, uint32_t offset);
+  void clearProgress();
+};
+
+#endif // DELTA_OTA_H
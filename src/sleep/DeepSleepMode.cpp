@@ -0,0 +1,126 @@
+#include "DeepSleepMode.h"
+
+#include <sys/time.h>
+
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+
+const char* DeepSleepMode::TAG = "deep_sleep";
+
+RTC_DATA_ATTR DeepSleepMode::Stats DeepSleepMode::stats = {};
+
+DeepSleepMode::DeepSleepMode(uint32_t wakeAheadMs, uint32_t syncIntervalHours)
+  : _wakeAheadMs(wakeAheadMs), _syncIntervalHours(syncIntervalHours) {
+
+}
+
+bool DeepSleepMode::isTimerWake() {
+  return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && stats.scheduledWake != 0;
+}
+
+bool DeepSleepMode::syncDue() {
+  return time(NULL) - stats.lastSyncAttempt >= (time_t)_syncIntervalHours * 3600;
+}
+
+void DeepSleepMode::markSyncAttempt() {
+  stats.lastSyncAttempt = time(NULL);
+}
+
+void DeepSleepMode::saveTimezone() {
+  const char* tz = getenv("TZ");
+  if (tz != nullptr) {
+    strlcpy(stats.timezone, tz, sizeof(stats.timezone));
+  }
+}
+
+void DeepSleepMode::restoreTimezone() {
+  if (stats.timezone[0] != 0) {
+    setenv("TZ", stats.timezone, 1);
+    tzset();
+  }
+}
+
+void DeepSleepMode::waitForMinute() {
+  stats.cycles++;
+
+  // Woken up a little early to compensate the boot time, wait for the boundary
+  int64_t current = now();
+  int64_t boundary = current - current % 60000000LL + 60000000LL;
+  if (boundary - current >= (int64_t)_wakeAheadMs * 2000) {
+    return; // Woken up after the boundary
+  }
+
+  // vTaskDelay() can return up to one tick early, the rest is busy waiting
+  vTaskDelay(pdMS_TO_TICKS((boundary - current) / 1000));
+  while ((current = now()) < boundary) {
+    delayMicroseconds(boundary - current < 1000 ? boundary - current : 1000);
+  }
+}
+
+void DeepSleepMode::recordPulse() {
+  if (stats.scheduledWake == 0) {
+    return;
+  }
+  uint32_t latency = now() - stats.scheduledWake;
+  stats.pulses++;
+  stats.sumLatencyUs += latency;
+  if (latency > stats.maxLatencyUs) {
+    stats.maxLatencyUs = latency;
+  }
+}
+
+void DeepSleepMode::report() {
+  if (stats.cycles == 0) {
+    return;
+  }
+  if (stats.pulses > 0) {
+    ESP_LOGI(TAG, "%u pulses, wake to pulse: max %u us, avg %u us", stats.pulses,
+             stats.maxLatencyUs, (uint32_t)(stats.sumLatencyUs / stats.pulses));
+  }
+  ESP_LOGI(TAG, "%u cycles, awake per minute: max %u us, avg %u us", stats.cycles,
+           stats.maxAwakeUs, (uint32_t)(stats.sumAwakeUs / stats.cycles));
+}
+
+void DeepSleepMode::sleepUntilNextMinute(gpio_num_t holdPin) {
+  int64_t current = now();
+
+  // Awake time of this cycle, only for cycles started by the timer
+  if (stats.scheduledWake != 0 && current > stats.scheduledWake && current - stats.scheduledWake < 60000000LL) {
+    uint32_t awake = current - stats.scheduledWake;
+    stats.sumAwakeUs += awake;
+    if (awake > stats.maxAwakeUs) {
+      stats.maxAwakeUs = awake;
+    }
+  }
+
+  int64_t boundary = current - current % 60000000LL + 60000000LL;
+  int64_t wake = boundary - (int64_t)_wakeAheadMs * 1000;
+  if (wake <= current) {
+    wake += 60000000LL; // Too close to the boundary, the pulse was already sent
+  }
+  stats.scheduledWake = wake;
+  sleep(wake - current, holdPin);
+}
+
+void DeepSleepMode::sleepFor(uint32_t seconds, gpio_num_t holdPin) {
+  stats.scheduledWake = 0; // No pulse planned, the next wake up is a full boot
+  sleep((uint64_t)seconds * 1000000ULL, holdPin);
+}
+
+int64_t DeepSleepMode::now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+void DeepSleepMode::sleep(uint64_t durationUs, gpio_num_t holdPin) {
+  // Keep the L293D disabled while the pads are not driven
+  digitalWrite(holdPin, LOW);
+  gpio_hold_en(holdPin);
+  gpio_deep_sleep_hold_en();
+
+  esp_sleep_enable_timer_wakeup(durationUs);
+  esp_deep_sleep_start();
+}
@@ -0,0 +1,67 @@
+#ifndef DEEP_SLEEP_MODE_H
+#define DEEP_SLEEP_MODE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// Deep sleep between the minute pulses for battery powered clocks.
+// Enable with -DSLAVECLOCK_DEEP_SLEEP in platformio.ini.
+// All state survives in RTC slow memory, the system time is kept by the RTC timer.
+class DeepSleepMode {
+public:
+  // Constructor, wakeAheadMs is the boot time to compensate, syncIntervalHours the time between SNTP syncs
+  DeepSleepMode(uint32_t wakeAheadMs, uint32_t syncIntervalHours);
+
+  // True if the chip was woken up by the RTC timer
+  bool isTimerWake();
+
+  // True if a full boot with WiFi and SNTP is due
+  bool syncDue();
+
+  // Remember the time of the sync attempt
+  void markSyncAttempt();
+
+  // Keep the timezone in RTC memory, the wake path has no NVS
+  void saveTimezone();
+  void restoreTimezone();
+
+  // Wait until the minute boundary, returns at or after it
+  void waitForMinute();
+
+  // Record the wake-to-pulse latency, call when the coil is energised
+  void recordPulse();
+
+  // Log the measured latency and awake time
+  void report();
+
+  // Hold the pin low and sleep until shortly before the next minute. Does not return
+  void sleepUntilNextMinute(gpio_num_t holdPin);
+
+  // Sleep for a fixed time, e.g. when no valid time is available. Does not return
+  void sleepFor(uint32_t seconds, gpio_num_t holdPin);
+
+private:
+  static const char* TAG;
+  static const size_t TIMEZONE_SIZE = 65;
+
+  struct Stats {
+    int64_t scheduledWake;     // System time of the planned wake up in microseconds
+    time_t lastSyncAttempt;
+    uint32_t cycles;
+    uint32_t pulses;           // Pulses sent in the wake path
+    uint32_t maxLatencyUs;     // Planned wake up to pulse
+    uint64_t sumLatencyUs;
+    uint32_t maxAwakeUs;       // Planned wake up to sleep
+    uint64_t sumAwakeUs;
+    char timezone[TIMEZONE_SIZE];
+  };
+  static Stats stats;
+
+  uint32_t _wakeAheadMs;
+  uint32_t _syncIntervalHours;
+
+  static int64_t now();
+  void sleep(uint64_t durationUs, gpio_num_t holdPin);
+};
+
+#endif // DEEP_SLEEP_MODE_H
@@ -2,40 +2,211 @@
 #include <cstring>
 #include <esp_log.h>
 
-static std::function<void()> globalSyncCallback = nullptr;
+#include "esp_netif.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
 
-NetworkTime::NetworkTime(const char* ntpServer, const char* timeZone)
-    : ntpServer(ntpServer), timeZone(timeZone), syncCallback(nullptr) {}
+const char* NetworkTime::TAG = "NetworkTime";
 
-void NetworkTime::init(std::function<void()> syncCallback) {
-    this->syncCallback = syncCallback;
-    globalSyncCallback = syncCallback; // Statisc variable für SNTP-CB
+// Seconds between the NTP epoch (1900) and the Unix epoch (1970)
+static const uint32_t NTP_UNIX_OFFSET = 2208988800UL;
 
-    // Configure SNTP
-    sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    sntp_setservername(0, ntpServer);
-    sntp_set_time_sync_notification_cb(onSyncCallback);
-    sntp_init();
+// Convert between microseconds since 1970 and 32.32 NTP timestamps
+static uint64_t toNtp(int64_t us) {
+  uint64_t seconds = us / 1000000 + NTP_UNIX_OFFSET;
+  uint64_t fraction = ((uint64_t)(us % 1000000) << 32) / 1000000;
+  return (seconds << 32) | fraction;
+}
 
-    // Set timezone
-    setenv("TZ", timeZone, 1);
-    tzset();
+static int64_t fromNtp(uint64_t ntp) {
+  int64_t seconds = (int64_t)(ntp >> 32) - NTP_UNIX_OFFSET;
+  int64_t us = ((ntp & 0xFFFFFFFF) * 1000000) >> 32;
+  return seconds * 1000000 + us;
 }
 
-// Get the current time
-bool NetworkTime::getTime(struct tm& timeInfo) {
-    time_t now;
-    time(&now);
-    if (localtime_r(&now, &timeInfo) == nullptr) {
-        ESP_LOGW("NetworkTime", "Zeit konnte nicht abgerufen werden");
-        return false;
+static uint64_t readTimestamp(const uint8_t* data) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+static void writeTimestamp(uint8_t* data, uint64_t value) {
+  for (int i = 7; i >= 0; i--) {
+    data[i] = value & 0xFF;
+    value >>= 8;
+  }
+}
+
+NetworkTime::NetworkTime(const char* const* servers, size_t serverCount, bool useGateway,
+                         void (*syncCallback)(struct timeval *tv))
+    : _servers(servers), _serverCount(serverCount), _useGateway(useGateway),
+      _syncCallback(syncCallback), _lastResult{} {}
+
+esp_err_t NetworkTime::sync(SyncResult& result) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    ESP_LOGE(TAG, "Failed to create socket");
+    return ESP_FAIL;
+  }
+  struct timeval timeout = { 0, TIMEOUT_MS * 1000 };
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  bool found = false;
+  memset(&result, 0, sizeof(result));
+
+  // Configured servers plus the gateway
+  for (size_t i = 0; i < _serverCount + (_useGateway ? 1 : 0); i++) {
+    char name[sizeof(result.server)];
+    uint32_t address;
+    uint16_t port = NTP_PORT;
+
+    if (i < _serverCount) {
+      strlcpy(name, _servers[i], sizeof(name));
+      if (!resolve(name, address, port)) {
+        continue;
+      }
+    } else {
+      esp_netif_ip_info_t ip_info;
+      esp_netif_t* netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+      if (netif == NULL || esp_netif_get_ip_info(netif, &ip_info) != ESP_OK || ip_info.gw.addr == 0) {
+        continue;
+      }
+      address = ip_info.gw.addr;
+      snprintf(name, sizeof(name), IPSTR, IP2STR(&ip_info.gw));
     }
-    return true;
+
+    for (int sample = 0; sample < SAMPLES_PER_SERVER; sample++) {
+      int64_t offset;
+      uint32_t delay;
+      if (!querySample(sock, address, port, offset, delay)) {
+        break; // Server does not answer, don't waste the radio window
+      }
+      ESP_LOGD(TAG, "%s: offset %lld us, delay %u us", name, offset, delay);
+
+      result.samples++;
+      if (!found || delay < result.delayUs) {
+        found = true;
+        result.offsetUs = offset;
+        result.delayUs = delay;
+        strlcpy(result.server, name, sizeof(result.server));
+      }
+    }
+  }
+  close(sock);
+
+  if (!found) {
+    ESP_LOGW(TAG, "No server answered");
+    return ESP_FAIL;
+  }
+
+  // Slew small offsets, step large ones
+  struct timeval tv;
+  if (result.offsetUs > -SLEW_LIMIT_US && result.offsetUs < SLEW_LIMIT_US) {
+    struct timeval delta = { (time_t)(result.offsetUs / 1000000), (suseconds_t)(result.offsetUs % 1000000) };
+    adjtime(&delta, NULL);
+    gettimeofday(&tv, NULL);
+  } else {
+    int64_t corrected = now() + result.offsetUs;
+    tv.tv_sec = corrected / 1000000;
+    tv.tv_usec = corrected % 1000000;
+    settimeofday(&tv, NULL);
+  }
+
+  ESP_LOGI(TAG, "Synced with %s: offset %lld us, delay %u us, %u samples",
+           result.server, result.offsetUs, result.delayUs, result.samples);
+
+  _lastResult = result;
+  if (_syncCallback) {
+    _syncCallback(&tv);
+  }
+  return ESP_OK;
 }
 
-// Static Callback
-void NetworkTime::onSyncCallback(struct timeval* tv) {
-    if (globalSyncCallback) {
-        globalSyncCallback(); // Calls the user-defined function
+bool NetworkTime::querySample(int sock, uint32_t address, uint16_t port, int64_t& offsetUs, uint32_t& delayUs) {
+  uint8_t packet[48];
+  memset(packet, 0, sizeof(packet));
+  packet[0] = 0x23; // LI 0, version 4, mode 3 (client)
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = address;
+
+  int64_t t1 = now();
+  uint64_t originate = toNtp(t1);
+  writeTimestamp(&packet[40], originate); // Transmit timestamp, echoed by the server
+
+  if (sendto(sock, packet, sizeof(packet), 0, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    return false;
+  }
+
+  // Skip stale answers of earlier samples
+  while (true) {
+    int len = recv(sock, packet, sizeof(packet), 0);
+    int64_t t4 = now();
+    if (len < 0) {
+      return false; // Timeout
+    }
+    if (len < 48 || readTimestamp(&packet[24]) != originate) {
+      continue;
+    }
+
+    uint8_t leap = packet[0] >> 6;
+    uint8_t mode = packet[0] & 0x07;
+    uint8_t stratum = packet[1];
+    if (leap == 3 || mode != 4 || stratum == 0 || stratum > 15) {
+      return false; // Unsynchronized or kiss-of-death
     }
-}
\ No newline at end of file
+
+    int64_t t2 = fromNtp(readTimestamp(&packet[32]));
+    int64_t t3 = fromNtp(readTimestamp(&packet[40]));
+
+    offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+    int64_t delay = (t4 - t1) - (t3 - t2);
+    delayUs = delay > 0 ? delay : 0;
+    return true;
+  }
+}
+
+bool NetworkTime::resolve(const char* server, uint32_t& address, uint16_t& port) {
+  char host[64];
+  strlcpy(host, server, sizeof(host));
+
+  char* separator = strchr(host, ':');
+  if (separator != NULL) {
+    *separator = 0;
+    port = atoi(separator + 1);
+  }
+
+  struct addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  struct addrinfo* res = NULL;
+
+  if (getaddrinfo(host, NULL, &hints, &res) != 0 || res == NULL) {
+    ESP_LOGW(TAG, "Failed to resolve %s", server);
+    return false;
+  }
+  address = ((struct sockaddr_in*)res->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(res);
+  return true;
+}
+
+// Get the current time
+bool NetworkTime::getTime(struct tm& timeInfo) {
+  time_t now;
+  time(&now);
+  if (localtime_r(&now, &timeInfo) == nullptr) {
+    ESP_LOGW(TAG, "Zeit konnte nicht abgerufen werden");
+    return false;
+  }
+  return true;
+}
+
+int64_t NetworkTime::now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
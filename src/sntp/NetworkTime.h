@@ -1,28 +1,54 @@
 #ifndef NETWORK_TIME_H
 #define NETWORK_TIME_H
 
-#include <esp_sntp.h>
 #include <ctime>
-#include <functional>
+#include <sys/time.h>
+#include "esp_err.h"
 
+// SNTP client that queries several servers with several samples each and
+// uses the sample with the lowest round-trip delay, like the NTP clock filter.
 class NetworkTime {
 public:
-    // Constructor
-    NetworkTime(const char* ntpServer, const char* timeZone);
+  /**
+   * @brief Result of a synchronisation.
+   */
+  struct SyncResult {
+    int64_t offsetUs;    // Correction applied to the system time
+    uint32_t delayUs;    // Round-trip delay of the chosen sample
+    char server[64];     // Server of the chosen sample
+    uint8_t samples;     // Number of valid samples
+  };
 
-    // Initialization of SNTP synchronization
-    void init(std::function<void()> syncCallback = nullptr);
+  // Constructor. Servers are host names or addresses with optional port, e.g. "192.168.0.10:1123".
+  // With useGateway the DHCP gateway is queried as well, many routers run an NTP server
+  NetworkTime(const char* const* servers, size_t serverCount, bool useGateway,
+              void (*syncCallback)(struct timeval *tv));
 
-    // Call up the current time
-    bool getTime(struct tm& timeInfo);
+  // Query all servers and set the system time. Blocks for at most a few seconds
+  esp_err_t sync(SyncResult& result);
+
+  // Result of the last successful sync
+  const SyncResult& lastResult() const { return _lastResult; }
+
+  // Get the current time
+  bool getTime(struct tm& timeInfo);
 
 private:
-    const char* ntpServer;
-    const char* timeZone;
-    std::function<void()> syncCallback;
+  static const char* TAG;
+  static const int SAMPLES_PER_SERVER = 4;
+  static const int TIMEOUT_MS = 500;
+  static const int64_t SLEW_LIMIT_US = 500000; // Larger offsets are stepped
+  static const uint16_t NTP_PORT = 123;
+
+  const char* const* _servers;
+  size_t _serverCount;
+  bool _useGateway;
+  void (*_syncCallback)(struct timeval *tv);
+  SyncResult _lastResult;
 
-    // Internal callback wrapping for SNTP
-    static void onSyncCallback(struct timeval* tv);
+  bool querySample(int sock, uint32_t address, uint16_t port, int64_t& offsetUs, uint32_t& delayUs);
+  bool resolve(const char* server, uint32_t& address, uint16_t& port);
+  static int64_t now();
 };
 
-#endif // NETWORK_TIME_H
\ No newline at end of file
+#endif // NETWORK_TIME_H
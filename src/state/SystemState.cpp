@@ -0,0 +1,125 @@
+#include "SystemState.h"
+
+#include "esp_log.h"
+
+const char* SystemState::TAG = "system_state";
+
+SystemState::SystemState()
+  : _mux(portMUX_INITIALIZER_UNLOCKED),
+    _state{0, WifiSmartConfig::WifiConnectStatus::Disconnected, false, false, false},
+    _eventGroup(NULL),
+    _subscriberCount(0) {
+
+}
+
+esp_err_t SystemState::init() {
+  _eventGroup = xEventGroupCreateStatic(&_eventGroupBuffer);
+  if (_eventGroup == NULL) {
+    ESP_LOGE(TAG, "Failed to create event group");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+void SystemState::setWifiStatus(WifiSmartConfig::WifiConnectStatus status) {
+  Snapshot copy;
+
+  portENTER_CRITICAL(&_mux);
+  _state.wifiStatus = status;
+  _state.version++;
+  copy = _state;
+  portEXIT_CRITICAL(&_mux);
+
+  if (_eventGroup != NULL) {
+    xEventGroupClearBits(_eventGroup, WIFI_CONNECTED | SMARTCONFIG);
+  }
+  if (status == WifiSmartConfig::WifiConnectStatus::Connected) {
+    update(WIFI_CONNECTED, true, copy);
+  } else if (status == WifiSmartConfig::WifiConnectStatus::Smartconfig) {
+    update(SMARTCONFIG, true, copy);
+  } else {
+    update(0, true, copy);
+  }
+}
+
+void SystemState::setTimeSynced(bool synced) {
+  Snapshot copy;
+
+  portENTER_CRITICAL(&_mux);
+  _state.timeSynced = synced;
+  _state.timeValid |= synced;
+  _state.version++;
+  copy = _state;
+  portEXIT_CRITICAL(&_mux);
+
+  update(synced ? TIME_SYNCED | TIME_VALID : TIME_SYNCED, synced, copy);
+}
+
+void SystemState::setTimeValid(bool valid) {
+  Snapshot copy;
+
+  portENTER_CRITICAL(&_mux);
+  _state.timeValid = valid;
+  _state.version++;
+  copy = _state;
+  portEXIT_CRITICAL(&_mux);
+
+  update(TIME_VALID, valid, copy);
+}
+
+void SystemState::setPositionKnown(bool known) {
+  Snapshot copy;
+
+  portENTER_CRITICAL(&_mux);
+  _state.positionKnown = known;
+  _state.version++;
+  copy = _state;
+  portEXIT_CRITICAL(&_mux);
+
+  update(POSITION_KNOWN, known, copy);
+}
+
+SystemState::Snapshot SystemState::snapshot() {
+  Snapshot copy;
+
+  portENTER_CRITICAL(&_mux);
+  copy = _state;
+  portEXIT_CRITICAL(&_mux);
+
+  return copy;
+}
+
+bool SystemState::waitFor(EventBits_t bits, TickType_t timeout) {
+  if (_eventGroup == NULL) {
+    ESP_LOGE(TAG, "Not initialized");
+    return false;
+  }
+  EventBits_t result = xEventGroupWaitBits(_eventGroup, bits, pdFALSE, pdTRUE, timeout);
+  return (result & bits) == bits;
+}
+
+bool SystemState::subscribe(Subscriber subscriber, void* context) {
+  if (_subscriberCount >= MAX_SUBSCRIBERS) {
+    ESP_LOGE(TAG, "Too many subscribers");
+    return false;
+  }
+  _subscribers[_subscriberCount] = subscriber;
+  _contexts[_subscriberCount] = context;
+  _subscriberCount++;
+  return true;
+}
+
+void SystemState::update(EventBits_t bits, bool set, const Snapshot& snapshot) {
+  // Wake up the waiting tasks first, then notify the subscribers
+  if (_eventGroup != NULL && bits != 0) {
+    if (set) {
+      xEventGroupSetBits(_eventGroup, bits);
+    } else {
+      xEventGroupClearBits(_eventGroup, bits);
+    }
+  }
+
+  for (int i = 0; i < _subscriberCount; i++) {
+    _subscribers[i](snapshot, _contexts[i]);
+  }
+}
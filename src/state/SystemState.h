@@ -0,0 +1,72 @@
+#ifndef SYSTEM_STATE_H
+#define SYSTEM_STATE_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#include "wifi/WifiSmartConfig.h"
+
+class SystemState {
+public:
+  /**
+   * @brief Event group bits. Tasks can block until a combination of them is set.
+   */
+  enum Bits : EventBits_t {
+    TIME_SYNCED    = BIT0,
+    WIFI_CONNECTED = BIT1,
+    SMARTCONFIG    = BIT2,
+    POSITION_KNOWN = BIT3,
+    TIME_VALID     = BIT4  // Synced, or retained by the RTC over a reset
+  };
+
+  /**
+   * @brief Consistent copy of the state. The version is incremented on every change.
+   */
+  struct Snapshot {
+    uint32_t version;
+    WifiSmartConfig::WifiConnectStatus wifiStatus;
+    bool timeSynced;
+    bool timeValid;
+    bool positionKnown;
+  };
+
+  // Subscriber, called in the context of the task that changed the state
+  typedef void (*Subscriber)(const Snapshot& snapshot, void* context);
+
+  SystemState();
+
+  esp_err_t init();
+
+  void setWifiStatus(WifiSmartConfig::WifiConnectStatus status);
+  void setTimeSynced(bool synced);
+  void setTimeValid(bool valid);
+  void setPositionKnown(bool known);
+
+  // Get a consistent copy of the current state
+  Snapshot snapshot();
+
+  // Block until all given bits are set. Returns false on timeout
+  bool waitFor(EventBits_t bits, TickType_t timeout = portMAX_DELAY);
+
+  // Register a subscriber. Must be called before the state is changed from other tasks
+  bool subscribe(Subscriber subscriber, void* context = nullptr);
+
+private:
+  static const char* TAG;
+  static const int MAX_SUBSCRIBERS = 4;
+
+  portMUX_TYPE _mux;
+  Snapshot _state;
+
+  StaticEventGroup_t _eventGroupBuffer;
+  EventGroupHandle_t _eventGroup;
+
+  Subscriber _subscribers[MAX_SUBSCRIBERS];
+  void* _contexts[MAX_SUBSCRIBERS];
+  int _subscriberCount;
+
+  void update(EventBits_t bits, bool set, const Snapshot& snapshot);
+};
+
+#endif // SYSTEM_STATE_H
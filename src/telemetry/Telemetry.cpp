@@ -0,0 +1,206 @@
+#include "Telemetry.h"
+
+#include <string.h>
+#include <time.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+const char* Telemetry::TAG = "telemetry";
+
+RTC_NOINIT_ATTR Telemetry::Retained Telemetry::retained;
+
+Telemetry::Telemetry(const char* brokerUri, const char* clientId)
+  : _brokerUri(brokerUri),
+    _clientId(clientId),
+    _mux(portMUX_INITIALIZER_UNLOCKED),
+    _client(NULL),
+    _publishedMsgId(-1),
+    _eventGroup(NULL) {
+  snprintf(_topic, sizeof(_topic), "slaveclock/%s/telemetry", clientId);
+}
+
+esp_err_t Telemetry::init() {
+  _eventGroup = xEventGroupCreateStatic(&_eventGroupBuffer);
+
+  // Records of the last run survive a reset, not a power cut
+  portENTER_CRITICAL(&_mux);
+  bool valid = retained.magic == MAGIC && retained.checksum == checksum(retained)
+               && retained.head - retained.tail <= TELEMETRY_RING_SIZE;
+  if (!valid) {
+    retained.magic = MAGIC;
+    retained.head = 0;
+    retained.tail = 0;
+    retained.dropped = 0;
+    retained.checksum = checksum(retained);
+  }
+  uint32_t count = retained.head - retained.tail;
+  portEXIT_CRITICAL(&_mux);
+
+  if (valid) {
+    ESP_LOGI(TAG, "%u records from RTC memory", count);
+  }
+
+  if (_brokerUri[0] == '\0') {
+    return ESP_OK; // Uplink disabled, only collect
+  }
+
+  // Created once at boot, so the heap stays the same between the windows
+  esp_mqtt_client_config_t config = {};
+  config.uri = _brokerUri;
+  config.client_id = _clientId;
+  _client = esp_mqtt_client_init(&config);
+  if (_client == NULL) {
+    ESP_LOGE(TAG, "Failed to init MQTT client");
+    return ESP_FAIL;
+  }
+  return esp_mqtt_client_register_event(_client, MQTT_EVENT_ANY, eventHandler, this);
+}
+
+void Telemetry::record(Type type, uint16_t a, int32_t b) {
+  Record record = { (uint32_t)time(NULL), type, 0, a, b };
+
+  portENTER_CRITICAL(&_mux);
+  if (retained.head - retained.tail >= TELEMETRY_RING_SIZE) {
+    // Ring full, overwrite the oldest record
+    retained.tail++;
+    retained.dropped++;
+  }
+  retained.records[retained.head % TELEMETRY_RING_SIZE] = record;
+  retained.head++;
+  retained.checksum = checksum(retained);
+  portEXIT_CRITICAL(&_mux);
+}
+
+uint32_t Telemetry::pending() {
+  portENTER_CRITICAL(&_mux);
+  uint32_t count = retained.head - retained.tail;
+  portEXIT_CRITICAL(&_mux);
+  return count;
+}
+
+esp_err_t Telemetry::publish() {
+  if (_client == NULL) {
+    return ESP_OK;
+  }
+  if (pending() == 0) {
+    xEventGroupSetBits(_eventGroup, DONE_BIT);
+    return ESP_OK;
+  }
+
+  uint32_t start = millis();
+  xEventGroupClearBits(_eventGroup, CONNECTED_BIT | PUBLISHED_BIT | ERROR_BIT);
+  esp_err_t err = esp_mqtt_client_start(_client);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start MQTT client %d", err);
+    xEventGroupSetBits(_eventGroup, DONE_BIT);
+    return err;
+  }
+
+  EventBits_t bits = xEventGroupWaitBits(_eventGroup, CONNECTED_BIT | ERROR_BIT, pdFALSE, pdFALSE,
+                                         pdMS_TO_TICKS(CONNECT_TIMEOUT_MS));
+  if (bits & CONNECTED_BIT) {
+    uint32_t count = pending();
+    while (err == ESP_OK && pending() > 0) {
+      err = sendBatch();
+    }
+    if (err == ESP_OK) {
+      ESP_LOGI(TAG, "Published %u records in %u ms", count, millis() - start);
+    }
+  } else {
+    ESP_LOGW(TAG, "Broker %s not reachable", _brokerUri);
+    err = ESP_ERR_TIMEOUT;
+  }
+
+  // Disconnect, the radio should not be kept busy between the windows
+  esp_mqtt_client_stop(_client);
+  xEventGroupSetBits(_eventGroup, DONE_BIT);
+  return err;
+}
+
+bool Telemetry::waitPublished(TickType_t timeout) {
+  if (_client == NULL) {
+    return true;
+  }
+  return xEventGroupWaitBits(_eventGroup, DONE_BIT, pdTRUE, pdFALSE, timeout) & DONE_BIT;
+}
+
+esp_err_t Telemetry::sendBatch() {
+  uint8_t message[12 + BATCH_SIZE * sizeof(Record)];
+
+  // Copy a batch, the ring may change while the message is on its way
+  portENTER_CRITICAL(&_mux);
+  uint32_t first = retained.tail;
+  uint32_t count = min(retained.head - retained.tail, (uint32_t)BATCH_SIZE);
+  uint32_t dropped = retained.dropped;
+  for (uint32_t i = 0; i < count; i++) {
+    memcpy(&message[12 + i * sizeof(Record)], &retained.records[(first + i) % TELEMETRY_RING_SIZE],
+           sizeof(Record));
+  }
+  portEXIT_CRITICAL(&_mux);
+
+  message[0] = 'T';
+  message[1] = VERSION;
+  message[2] = count;
+  message[3] = sizeof(Record);
+  memcpy(&message[4], &first, sizeof(first));
+  memcpy(&message[8], &dropped, sizeof(dropped));
+
+  xEventGroupClearBits(_eventGroup, PUBLISHED_BIT);
+  _publishedMsgId = -1;
+  int msgId = esp_mqtt_client_publish(_client, _topic, (const char*)message,
+                                      12 + count * sizeof(Record), 1, 0);
+  if (msgId < 0) {
+    ESP_LOGE(TAG, "Publish failed");
+    return ESP_FAIL;
+  }
+
+  // QoS 1: keep the records until the broker has them. The acknowledge may
+  // arrive before publish() returns, so the id is compared here, not in the handler
+  uint32_t start = millis();
+  while (_publishedMsgId != msgId) {
+    uint32_t elapsed = millis() - start;
+    EventBits_t bits = 0;
+    if (elapsed < ACK_TIMEOUT_MS) {
+      bits = xEventGroupWaitBits(_eventGroup, PUBLISHED_BIT | ERROR_BIT, pdTRUE, pdFALSE,
+                                 pdMS_TO_TICKS(ACK_TIMEOUT_MS - elapsed));
+    }
+    if (!(bits & PUBLISHED_BIT)) {
+      ESP_LOGW(TAG, "No acknowledge from broker");
+      return ESP_ERR_TIMEOUT;
+    }
+  }
+
+  portENTER_CRITICAL(&_mux);
+  // Records overwritten meanwhile have moved the tail already
+  if ((int32_t)(first + count - retained.tail) > 0) {
+    retained.tail = first + count;
+    retained.checksum = checksum(retained);
+  }
+  portEXIT_CRITICAL(&_mux);
+  return ESP_OK;
+}
+
+uint32_t Telemetry::checksum(const Retained& data) {
+  return data.magic ^ data.head ^ (data.tail << 1) ^ (data.dropped << 2) ^ 0xA5A5A5A5;
+}
+
+void Telemetry::eventHandler(void* args, esp_event_base_t base, int32_t eventId, void* eventData) {
+  Telemetry* telemetry = static_cast<Telemetry*>(args);
+  esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(eventData);
+
+  switch ((esp_mqtt_event_id_t)eventId) {
+    case MQTT_EVENT_CONNECTED:
+      xEventGroupSetBits(telemetry->_eventGroup, CONNECTED_BIT);
+      break;
+    case MQTT_EVENT_PUBLISHED:
+      telemetry->_publishedMsgId = event->msg_id;
+      xEventGroupSetBits(telemetry->_eventGroup, PUBLISHED_BIT);
+      break;
+    case MQTT_EVENT_DISCONNECTED:
+    case MQTT_EVENT_ERROR:
+      xEventGroupSetBits(telemetry->_eventGroup, ERROR_BIT);
+      break;
+    default:
+      break;
+  }
+}
@@ -0,0 +1,102 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "mqtt_client.h"
+
+// Records in the ring. 12 bytes each, kept in RTC memory
+#ifndef TELEMETRY_RING_SIZE
+#define TELEMETRY_RING_SIZE 256
+#endif
+
+// Store-and-forward telemetry. Events and metric snapshots are kept as compact
+// binary records in a ring in RTC memory, so they survive network outages and
+// resets. publish() sends them in one burst over MQTT and drops a batch only
+// after the broker acknowledged it. When the ring is full the oldest records
+// are overwritten and counted.
+//
+// Message format, little endian, topic "slaveclock/<client id>/telemetry":
+//   uint8 'T', uint8 version, uint8 record count, uint8 record size,
+//   uint32 sequence number of the first record, uint32 records dropped so far,
+//   followed by the records.
+class Telemetry {
+public:
+  enum class Type : uint8_t {
+    Boot = 1,   // a: esp_reset_reason()
+    Sync,       // a: round-trip delay in ms, b: applied offset in ms
+    Drift,      // At the start of a correction. a: minutes from the hands forward to the time, b: pulses sent, 0 if the hands wait
+    Pulses,     // a: max lateness of the minute pulse in ms, b: total pulses
+    Heap,       // a: largest free block in KiB, b: free heap in bytes
+    Stack       // a: lowest high water mark of all tasks in bytes
+  };
+
+  struct __attribute__((packed)) Record {
+    uint32_t time;   // Unix time, small values before the first sync
+    Type type;
+    uint8_t reserved;
+    uint16_t a;
+    int32_t b;
+  };
+
+  // Constructor. An empty broker URI (e.g. "mqtt://192.168.0.10") disables the uplink
+  Telemetry(const char* brokerUri, const char* clientId);
+
+  // Take over the records of the last run from RTC memory and create the MQTT client
+  esp_err_t init();
+
+  // Add a record. Never blocks, safe from any task
+  void record(Type type, uint16_t a, int32_t b = 0);
+
+  // Records not acknowledged by the broker yet
+  uint32_t pending();
+
+  // Connect to the broker, send all pending records and disconnect.
+  // Call once per network window, blocks for at most a few seconds
+  esp_err_t publish();
+
+  // Block until a publish() has finished, successful or not. True at once if
+  // the uplink is disabled. Used before the radio goes off for deep sleep
+  bool waitPublished(TickType_t timeout);
+
+private:
+  static const char* TAG;
+  static const uint32_t MAGIC = 0x54454C45; // "TELE"
+  static const uint8_t VERSION = 1;
+  static const int BATCH_SIZE = 32;          // Records per message, fits the default MQTT buffer
+  static const int CONNECT_TIMEOUT_MS = 10000;
+  static const int ACK_TIMEOUT_MS = 5000;
+
+  static const EventBits_t CONNECTED_BIT = BIT0;
+  static const EventBits_t PUBLISHED_BIT = BIT1;
+  static const EventBits_t ERROR_BIT = BIT2;
+  static const EventBits_t DONE_BIT = BIT3;   // Cleared by waitPublished()
+
+  struct Retained {
+    uint32_t magic;
+    uint32_t head;      // Sequence number of the next record
+    uint32_t tail;      // Sequence number of the oldest record not acknowledged
+    uint32_t dropped;
+    uint32_t checksum;
+    Record records[TELEMETRY_RING_SIZE];
+  };
+  static Retained retained;
+
+  const char* _brokerUri;
+  const char* _clientId;
+  char _topic[64];
+
+  portMUX_TYPE _mux;
+  esp_mqtt_client_handle_t _client;
+  volatile int _publishedMsgId;  // Last message acknowledged by the broker
+  StaticEventGroup_t _eventGroupBuffer;
+  EventGroupHandle_t _eventGroup;
+
+  esp_err_t sendBatch();
+  static uint32_t checksum(const Retained& data);
+  static void eventHandler(void* args, esp_event_base_t base, int32_t eventId, void* eventData);
+};
+
+#endif // TELEMETRY_H
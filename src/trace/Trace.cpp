@@ -0,0 +1,127 @@
+#include "Trace.h"
+
+#ifdef SLAVECLOCK_TRACE
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_freertos_hooks.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char* TAG = "trace";
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+DRAM_ATTR Trace::Entry Trace::buffer[TRACE_BUFFER_SIZE];
+DRAM_ATTR uint32_t Trace::head = 0;
+DRAM_ATTR bool Trace::paused = false;
+DRAM_ATTR void* Trace::tasks[MAX_TASKS];
+DRAM_ATTR void* Trace::lastTask[portNUM_PROCESSORS];
+
+void Trace::init() {
+  // The precompiled FreeRTOS of the Arduino core has no traceTASK_SWITCHED_IN/OUT
+  // hooks, so task switches are sampled from the tick interrupt of each core (1 ms)
+  esp_register_freertos_tick_hook_for_cpu(tickHook0, 0);
+#if portNUM_PROCESSORS > 1
+  esp_register_freertos_tick_hook_for_cpu(tickHook1, 1);
+#endif
+  ESP_LOGI(TAG, "Tracing enabled, %d entries", TRACE_BUFFER_SIZE);
+}
+
+IRAM_ATTR uint8_t Trace::taskId(void* handle) {
+  // Called with traceMux held
+  for (int i = 0; i < MAX_TASKS; i++) {
+    if (tasks[i] == handle) {
+      return i;
+    }
+    if (tasks[i] == nullptr) {
+      tasks[i] = handle;
+      return i;
+    }
+  }
+  return MAX_TASKS; // Table full
+}
+
+IRAM_ATTR void Trace::write(Event event, uint8_t cpu, uint8_t task, uint16_t arg) {
+  if (paused) {
+    return;
+  }
+  Entry& entry = buffer[head % TRACE_BUFFER_SIZE];
+  entry.timestamp = (uint32_t)esp_timer_get_time();
+  entry.event = (uint8_t)event;
+  entry.cpuTask = (cpu << 7) | (task & 0x7F);
+  entry.arg = arg;
+  head++;
+}
+
+void Trace::record(Event event, uint16_t arg) {
+  uint8_t cpu = xPortGetCoreID();
+  void* handle = xTaskGetCurrentTaskHandle();
+
+  portENTER_CRITICAL_SAFE(&traceMux);
+  write(event, cpu, taskId(handle), arg);
+  portEXIT_CRITICAL_SAFE(&traceMux);
+}
+
+IRAM_ATTR void Trace::sampleTask(uint8_t cpu) {
+  void* handle = xTaskGetCurrentTaskHandleForCPU(cpu);
+  if (handle == lastTask[cpu]) {
+    return;
+  }
+  lastTask[cpu] = handle;
+
+  portENTER_CRITICAL_ISR(&traceMux);
+  write(Event::TaskSwitch, cpu, taskId(handle), 0);
+  portEXIT_CRITICAL_ISR(&traceMux);
+}
+
+IRAM_ATTR void Trace::tickHook0() {
+  sampleTask(0);
+}
+
+IRAM_ATTR void Trace::tickHook1() {
+  sampleTask(1);
+}
+
+void Trace::dump(Print& out) {
+  portENTER_CRITICAL(&traceMux);
+  paused = true;
+  portEXIT_CRITICAL(&traceMux);
+
+  // Resolve task names of the tasks that are still alive
+  static TaskStatus_t status[MAX_TASKS];
+  UBaseType_t count = uxTaskGetSystemState(status, MAX_TASKS, nullptr);
+
+  out.println("TRACE BEGIN");
+  for (int i = 0; i < MAX_TASKS && tasks[i] != nullptr; i++) {
+    const char* name = nullptr;
+    for (UBaseType_t j = 0; j < count; j++) {
+      if ((void*)status[j].xHandle == tasks[i]) {
+        name = status[j].pcTaskName;
+        break;
+      }
+    }
+    if (name != nullptr) {
+      out.printf("T %d %s\n", i, name);
+    } else {
+      out.printf("T %d task%d\n", i, i);
+    }
+  }
+
+  uint32_t first = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+  for (uint32_t i = first; i < head; i++) {
+    const Entry& entry = buffer[i % TRACE_BUFFER_SIZE];
+    out.printf("E %u %u %u %u %u\n", entry.timestamp, entry.cpuTask >> 7, entry.cpuTask & 0x7F,
+               entry.event, entry.arg);
+  }
+  out.println("TRACE END");
+
+  portENTER_CRITICAL(&traceMux);
+  head = 0;
+  for (int i = 0; i < portNUM_PROCESSORS; i++) {
+    lastTask[i] = nullptr;
+  }
+  paused = false;
+  portEXIT_CRITICAL(&traceMux);
+}
+
+#endif // SLAVECLOCK_TRACE
@@ -0,0 +1,69 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// Opt-in tracing of scheduling, mutex and pulse events.
+// Enable with -DSLAVECLOCK_TRACE in platformio.ini, send 't' over serial to
+// dump the buffer and convert the output with tools/trace2json.py.
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 2048 // Number of events, 8 bytes each
+#endif
+
+class Trace {
+public:
+  /**
+   * @brief Types of recorded events. The values are part of the dump format.
+   */
+  enum class Event : uint8_t {
+    TaskSwitch = 1, // arg: -
+    MutexWait  = 2, // arg: mutex id
+    MutexTake  = 3, // arg: mutex id
+    MutexGive  = 4, // arg: mutex id
+    PulseStart = 5, // arg: polarity
+    PulseEnd   = 6, // arg: polarity
+    Mark       = 7  // arg: user value
+  };
+
+  // Register the tick hooks that sample task switches on both cores
+  static void init();
+
+  // Record an event for the calling task. Safe from task and ISR context
+  static void record(Event event, uint16_t arg = 0);
+
+  // Write the buffer to the given output. Recording is paused while dumping
+  static void dump(Print& out);
+
+private:
+  struct Entry {
+    uint32_t timestamp; // Microseconds since boot, wraps after ~71 minutes
+    uint8_t  event;
+    uint8_t  cpuTask;   // Bit 7: cpu, bits 0-6: task id
+    uint16_t arg;
+  };
+
+  static const int MAX_TASKS = 32;
+
+  static Entry buffer[TRACE_BUFFER_SIZE];
+  static uint32_t head;
+  static bool paused;
+  static void* tasks[MAX_TASKS];
+  static void* lastTask[portNUM_PROCESSORS];
+
+  static uint8_t taskId(void* handle);
+  static void write(Event event, uint8_t cpu, uint8_t task, uint16_t arg);
+  static void tickHook0();
+  static void tickHook1();
+  static void sampleTask(uint8_t cpu);
+};
+
+#ifdef SLAVECLOCK_TRACE
+#define TRACE_INIT()            Trace::init()
+#define TRACE_EVENT(event, arg) Trace::record(Trace::Event::event, (arg))
+#else
+#define TRACE_INIT()
+#define TRACE_EVENT(event, arg)
+#endif
+
+#endif // TRACE_H
@@ -11,7 +11,6 @@
 #include "esp_wifi.h"
 
 #include "esp_log.h"
-#include "esp_sntp.h"
 #include "esp_smartconfig.h"
 
 #include "nvs_flash.h"
@@ -27,17 +26,18 @@ const char* WifiSmartConfig::TIMEZONE_VALUE = "TZ";
 const int WIFI_CONNECTED_BIT = BIT0;
 const int WIFI_FAIL_BIT      = BIT1;
 const int ESPTOUCH_DONE_BIT  = BIT2;
+const int SC_CHANNEL_BIT     = BIT3;
 
 
 WifiSmartConfig::WifiSmartConfig(const char* aes_key, const char* hostname, 
-                                 const char* ntp_server,
-                                 void (*connectionCallback)(WifiConnectStatus status),
-                                 void (*sntpCallback)(struct timeval *tv)) 
+                                 void (*connectionCallback)(WifiConnectStatus status)) 
   : _aes_key(aes_key),  
     _hostname(hostname),
-    _ntp_server(ntp_server), 
-    _connectionCallback(connectionCallback), 
-    _sntpCallback(sntpCallback) { 
+    _connected(false),
+    _retrying(false),
+    _lastConnect({ ConnectPath::None, 0, 0 }),
+    _reconnect_timer(NULL),
+    _connectionCallback(connectionCallback) { 
 
 }
 
@@ -62,12 +62,16 @@ esp_err_t WifiSmartConfig::init() {
   }
 
   // Create a new event group.
-  _wifi_event_group = xEventGroupCreate();
+  _wifi_event_group = xEventGroupCreateStatic(&_wifi_event_group_buffer);
   if (_wifi_event_group == NULL) {
     ESP_LOGE(TAG, "Failed to create event group");
     return ESP_FAIL;
   }
 
+  // Reconnect after a lost connection without blocking the event loop
+  _reconnect_timer = xTimerCreateStatic("WifiReconnect", pdMS_TO_TICKS(RECONNECT_DELAY_MS), pdFALSE, this,
+                                        reconnect, &_reconnect_timer_buffer);
+
   // Create default event loop
   ret = esp_event_loop_create_default();
   if (ret != ESP_OK) {
@@ -150,100 +154,165 @@ esp_err_t WifiSmartConfig::init() {
 
 
 esp_err_t WifiSmartConfig::connect() {
-    EventBits_t bits;
+  wifi_config_t wifi_config;
 
-    wifi_config_t wifi_config;
+  esp_err_t ret = esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to get config");
+    return ret;
+  }
+  bool stored = strlen((const char*)wifi_config.sta.ssid) > 0;
+  if (stored) {
+    ESP_LOGI(TAG, "Flash SSID: %s", wifi_config.sta.ssid);
+    ESP_LOGI(TAG, "Flash Password: %s", wifi_config.sta.password);
+  } else {
+    ESP_LOGE(TAG, "Nothing in flash");
+  }
 
-    esp_err_t ret = esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get config");
+  _connected = false;
+  _retrying = false;
+  _lastConnect = { ConnectPath::None, 0, 0 };
+
+  ret = esp_wifi_start();
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start wifi");
     return ret;
+  }
+
+  // SmartConfig hops the channels, so it can't listen while the stored AP is tried.
+  // Alternate both with fixed time budgets, a router that is down at boot is
+  // found again as soon as it is back
+  uint32_t start = millis();
+  uint8_t windows = 0;
+  while (millis() - start < CONNECT_BUDGET_MS) {
+    if (stored && connectStored(STORED_TIMEOUT_MS)) {
+      _lastConnect = { ConnectPath::Stored, millis() - start, windows };
+      ESP_LOGI(TAG, "Connected to stored AP after %u ms", _lastConnect.ms);
+      return ESP_OK;
     }
-    if (strlen((const char*)wifi_config.sta.ssid)) {
-        ESP_LOGI(TAG, "Flash SSID: %s", wifi_config.sta.ssid);
-        ESP_LOGI(TAG, "Flash Password: %s", wifi_config.sta.password);
-    } else {
-        ESP_LOGE(TAG, "Nothing in flash");
+
+    windows++;
+    if (listenSmartConfig(SMARTCONFIG_WINDOW_MS)) {
+      _lastConnect = { ConnectPath::Smartconfig, millis() - start, windows };
+      ESP_LOGI(TAG, "Connected via SmartConfig after %u ms, window %u", _lastConnect.ms, windows);
+      return ESP_OK;
     }
 
-    _connected = false;
+    // SmartConfig may have stored new credentials
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
+      stored = strlen((const char*)wifi_config.sta.ssid) > 0;
+    }
+  }
 
-    /* -------------- Try to connect with stored settings ------------- */
-    _retry_num = 0;
+  ESP_LOGW(TAG, "No connection within %u s", CONNECT_BUDGET_MS / 1000);
+  return ESP_ERR_TIMEOUT;
+}
 
-    ret = esp_wifi_start();
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start wifi");
-        return ret;
-    }
+bool WifiSmartConfig::connectStored(uint32_t timeoutMs) {
+  xEventGroupClearBits(_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+  _retry_num = 0;
+  _retrying = true;
 
-    ESP_LOGI(TAG, "WIFI startet. Waiting for events.");
+  if (esp_wifi_connect() != ESP_OK) {
+    ESP_LOGE(TAG, "Could not connect");
+    _retrying = false;
+    return false;
+  }
 
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) 
-     * or connection failed for the maximum number of re-tries (WIFI_FAIL_BIT). 
-     * The bits are set by event_handler() (see above) */
-    bits = xEventGroupWaitBits(_wifi_event_group,
-                            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                            pdTRUE,
-                            pdFALSE,
-                            portMAX_DELAY);
+  // The event handler retries up to MAXIMUM_RETRY times
+  EventBits_t bits = xEventGroupWaitBits(_wifi_event_group,
+                                         WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+                                         pdTRUE,
+                                         pdFALSE,
+                                         pdMS_TO_TICKS(timeoutMs));
+  if (bits & WIFI_CONNECTED_BIT) {
+    return true;
+  }
 
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to ap SSID: %s password: %s", wifi_config.sta.ssid, wifi_config.sta.password);
-        return ESP_OK;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID: %s, password:%s", wifi_config.sta.ssid, wifi_config.sta.password);
-    } else {
-        ESP_LOGE(TAG, "Unexpected event");
-    }
+  if (bits & WIFI_FAIL_BIT) {
+    ESP_LOGI(TAG, "Failed to connect to stored AP");
+  } else {
+    ESP_LOGI(TAG, "No connection to stored AP within %u ms", timeoutMs);
+  }
+  _retrying = false;
+  _connected = false; // Associated without IP address, don't start the reconnect timer
+  esp_wifi_disconnect();
+  return false;
+}
 
-    /* -------------- Try to connect with smartconfig ------------- */
-    _retry_num = 0;
+bool WifiSmartConfig::listenSmartConfig(uint32_t windowMs) {
+  xEventGroupClearBits(_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT | ESPTOUCH_DONE_BIT | SC_CHANNEL_BIT);
 
-    ret = esp_smartconfig_set_type(SC_TYPE_ESPTOUCH_V2);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set smartconfig type");
-        return ret;
-    }
-    smartconfig_start_config_t smart_cfg;
-    memset(&smart_cfg, 0, sizeof(smartconfig_start_config_t)); // Ensure that the struct is initialized
-    smart_cfg.enable_log = false;
-    smart_cfg.esp_touch_v2_enable_crypt = true;
-    smart_cfg.esp_touch_v2_key = const_cast<char*>(_aes_key);
+  esp_err_t ret = esp_smartconfig_set_type(SC_TYPE_ESPTOUCH_V2);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to set smartconfig type");
+    return false;
+  }
+  smartconfig_start_config_t smart_cfg;
+  memset(&smart_cfg, 0, sizeof(smartconfig_start_config_t)); // Ensure that the struct is initialized
+  smart_cfg.enable_log = false;
+  smart_cfg.esp_touch_v2_enable_crypt = true;
+  smart_cfg.esp_touch_v2_key = const_cast<char*>(_aes_key);
 
-    _connectionCallback(WifiConnectStatus::Smartconfig);
+  _connectionCallback(WifiConnectStatus::Smartconfig);
 
-    ret = esp_smartconfig_start(&smart_cfg);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start smartconfig");
-        return ret;
+  ret = esp_smartconfig_start(&smart_cfg);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start smartconfig");
+    return false;
+  }
+
+  uint32_t start = millis();
+  uint32_t deadline = windowMs;
+  bool extended = false;
+  bool connected = false;
+  while (true) {
+    // Read the clock once, so the remaining time can't wrap around
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= deadline) {
+      break;
+    }
+    EventBits_t bits = xEventGroupWaitBits(_wifi_event_group,
+                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT | ESPTOUCH_DONE_BIT | SC_CHANNEL_BIT,
+                                           pdTRUE,
+                                           pdFALSE,
+                                           pdMS_TO_TICKS(deadline - elapsed));
+
+    if (bits & ESPTOUCH_DONE_BIT) {
+      ESP_LOGI(TAG, "Touch done");
+      connected = true;
+      break;
     }
+    if (bits & WIFI_CONNECTED_BIT) {
+      // Give the phone app its ack before SmartConfig stops
+      ESP_LOGI(TAG, "connected via smart config");
+      connected = true;
+      deadline = millis() - start + SMARTCONFIG_ACK_MS;
+    }
+    if (bits & WIFI_FAIL_BIT) {
+      ESP_LOGI(TAG, "Failed to connect via smart config");
+      break;
+    }
+    if ((bits & SC_CHANNEL_BIT) && !extended) {
+      // The phone app is sending, don't interrupt it
+      ESP_LOGI(TAG, "SmartConfig window extended");
+      deadline += SMARTCONFIG_EXTEND_MS;
+      extended = true;
+    }
+  }
 
-    do {
-        bits = xEventGroupWaitBits(_wifi_event_group,
-                                    WIFI_CONNECTED_BIT | WIFI_FAIL_BIT | ESPTOUCH_DONE_BIT,
-                                    pdTRUE,
-                                    pdFALSE,
-                                    portMAX_DELAY);
-
-        if (bits & WIFI_CONNECTED_BIT) {
-            ESP_LOGI(TAG, "connected via smart config");
-        } else if (bits & ESPTOUCH_DONE_BIT) {
-            ESP_LOGI(TAG, "Touch done");
-            esp_smartconfig_stop();
-            return ESP_OK;
-        } else if (bits & WIFI_FAIL_BIT) {
-            ESP_LOGI(TAG, "Failed to connect via smart config");
-            esp_smartconfig_stop();
-            esp_wifi_stop();
-            return ESP_FAIL;
-        } else {
-            ESP_LOGE(TAG, "Unexpected event");
-            esp_smartconfig_stop();
-            esp_wifi_stop();
-            return ESP_FAIL;
-        }
-    } while (true);
+  esp_smartconfig_stop();
+  if (!connected) {
+    _retrying = false;
+    _connected = false;
+    esp_wifi_disconnect();
+  }
+  return connected;
+}
+
+void WifiSmartConfig::reconnect(TimerHandle_t timer) {
+  ESP_LOGI(TAG, "Retry to connect to the AP");
+  esp_wifi_connect();
 }
 
 esp_err_t WifiSmartConfig::start() {
@@ -278,6 +347,9 @@ void WifiSmartConfig::handleWifiEvent(WifiSmartConfig* self, int32_t event_id, v
   switch (event_id) {
     case WIFI_EVENT_STA_START:
       ESP_LOGI(self->TAG, "WIFI_EVENT_STA_START");
+      if (!self->_retrying) {
+        break; // connect() decides what to try first
+      }
       if (esp_wifi_connect() != ESP_OK) {
         ESP_LOGE(self->TAG, "Could not connect");
         esp_wifi_disconnect();
@@ -296,11 +368,10 @@ void WifiSmartConfig::handleWifiEvent(WifiSmartConfig* self, int32_t event_id, v
       ESP_LOGI(self->TAG, "WIFI_EVENT_STA_DISCONNECTED");
       self->_connectionCallback(WifiConnectStatus::Disconnected);
       if (self->_connected) {
-        // WIFI was already connected. Perhaps router down? Try reconnecting 
+        // WIFI was already connected. Perhaps router down? Try reconnecting in a minute
         ESP_LOGI(self->TAG, "Already connected. Retry to connect to the AP");
-        vTaskDelay((1000 * 60) / portTICK_PERIOD_MS); // Wait 1 minute
-        esp_wifi_connect();
-      } else {
+        xTimerStart(self->_reconnect_timer, 0);
+      } else if (self->_retrying) {
         // WIFI was not connected. So there is a problem
         if (self->_retry_num < self->MAXIMUM_RETRY) {
           ESP_LOGI(self->TAG, "Cannot connect. Retry to connect to the AP");
@@ -335,6 +406,7 @@ void WifiSmartConfig::handleSmartConfigEvent(WifiSmartConfig* self, int32_t even
       break;
     case SC_EVENT_FOUND_CHANNEL:
       ESP_LOGI(self->TAG, "SC_EVENT_FOUND_CHANNEL");
+      xEventGroupSetBits(self->_wifi_event_group, SC_CHANNEL_BIT);
       break;
     case SC_EVENT_GOT_SSID_PSWD: {
       ESP_LOGI(self->TAG, "SC_EVENT_GOT_SSID_PSWD");
@@ -365,6 +437,8 @@ void WifiSmartConfig::handleSmartConfigEvent(WifiSmartConfig* self, int32_t even
 
       ESP_ERROR_CHECK( esp_wifi_disconnect() );
       ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
+      self->_retry_num = 0;
+      self->_retrying = true;
       if (esp_wifi_connect() != ESP_OK) {
         ESP_LOGE(self->TAG, "Could not connect");
         esp_wifi_disconnect();
@@ -381,24 +455,12 @@ void WifiSmartConfig::handleSmartConfigEvent(WifiSmartConfig* self, int32_t even
   }
 }
 
-esp_err_t WifiSmartConfig::initSNTP() {
-    ESP_LOGI(TAG, "Init SNTP");
-
-    sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    sntp_setservername(0, _ntp_server);
-    sntp_set_time_sync_notification_cb(_sntpCallback); 
-
-    sntp_init();
-
-    return ESP_OK;
-}
-
 esp_err_t WifiSmartConfig::initTimezone() {
   esp_err_t err;
 
   ESP_LOGI(TAG, "Init timezone");
 
-  char *timezone_value;
+  static char timezone_value[TIMEZONE_SIZE];
   size_t timezone_size = 0;
 
   nvs_handle_t my_handle;
@@ -412,11 +474,15 @@ esp_err_t WifiSmartConfig::initTimezone() {
     ESP_LOGE(TAG, "Failed to read size from NVS %d", err);
     return ESP_FAIL;
   }
-  timezone_value = (char*)malloc(timezone_size);
+  if (timezone_size > sizeof(timezone_value)) {
+    ESP_LOGE(TAG, "Timezone too long %d", timezone_size);
+    nvs_close(my_handle);
+    return ESP_FAIL;
+  }
   err = nvs_get_str(my_handle, TIMEZONE_VALUE, timezone_value, &timezone_size);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to read value from NVS %d", err);
-    free(timezone_value); // Release memory because the value could not be read
+    nvs_close(my_handle);
     return ESP_FAIL;
   }
   nvs_close(my_handle);
@@ -428,7 +494,5 @@ esp_err_t WifiSmartConfig::initTimezone() {
   setenv(TIMEZONE_VALUE, timezone_value, 1);
   tzset();
 
-  free(timezone_value); // Release memory after the value has been used
-  
   return ESP_OK;
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #include <Arduino.h>
 #include "esp_err.h"
 #include "esp_event.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/timers.h"
 
 class WifiSmartConfig {
 public:
@@ -18,17 +21,35 @@ public:
     Smartconfig
   };
 
-  WifiSmartConfig(const char* aes_key, const char* hostname, const char* ntp_server,
-                 void (*connectionCallback)(WifiConnectStatus status),
-                 void (*sntpCallback)(struct timeval *tv));
+  /**
+   * @brief How the last connect() succeeded and how long it took.
+   */
+  enum class ConnectPath {
+    None,
+    Stored,
+    Smartconfig
+  };
+
+  struct ConnectResult {
+    ConnectPath path;
+    uint32_t ms;        // Time from the call of connect() to the IP address
+    uint8_t windows;    // SmartConfig windows opened before
+  };
+
+  WifiSmartConfig(const char* aes_key, const char* hostname,
+                 void (*connectionCallback)(WifiConnectStatus status));
 
   ~WifiSmartConfig();
 
   esp_err_t init();
+
+  // Alternate between the stored AP and SmartConfig windows until one of them
+  // connects. Returns ESP_ERR_TIMEOUT after CONNECT_BUDGET_MS
   esp_err_t connect();
+  const ConnectResult& lastConnect() const { return _lastConnect; }
+
   esp_err_t start();
   esp_err_t stop();
-  esp_err_t initSNTP();
   esp_err_t initTimezone();
 
 
@@ -36,19 +57,34 @@ public:
 private:
   static const char* TAG;
   static const int MAXIMUM_RETRY = 10;
+  static const uint32_t STORED_TIMEOUT_MS = 20000;       // One attempt with the stored AP, up to MAXIMUM_RETRY connects
+  static const uint32_t SMARTCONFIG_WINDOW_MS = 60000;   // SmartConfig listens between the attempts
+  static const uint32_t SMARTCONFIG_EXTEND_MS = 60000;   // More time once the phone app was found
+  static const uint32_t SMARTCONFIG_ACK_MS = 5000;       // Wait for the ack to the phone after connecting
+  static const uint32_t CONNECT_BUDGET_MS = 10 * 60000;
+  static const uint32_t RECONNECT_DELAY_MS = 60000;      // Lost connection, perhaps router down
   static const char* NVS_NAMESPACE;
   static const char* TIMEZONE_VALUE;
+  static const size_t TIMEZONE_SIZE = 65; // Maximum size of the SmartConfig reserved data
 
   const char* _aes_key;
   const char* _hostname;
-  const char* _ntp_server;
 
+  StaticEventGroup_t _wifi_event_group_buffer;
   EventGroupHandle_t _wifi_event_group;
   int _retry_num;
-  bool _connected;
+  volatile bool _connected;
+  volatile bool _retrying;      // Reconnect on disconnect, off while SmartConfig listens
+  ConnectResult _lastConnect;
+
+  StaticTimer_t _reconnect_timer_buffer;
+  TimerHandle_t _reconnect_timer;
 
   void (*_connectionCallback)(WifiConnectStatus status);
-  void (*_sntpCallback)(struct timeval *tv);
+
+  bool connectStored(uint32_t timeoutMs);
+  bool listenSmartConfig(uint32_t windowMs);
+  static void reconnect(TimerHandle_t timer);
 
   static void connect_event_handler(void* arg, esp_event_base_t event_base, 
                                    int32_t event_id, void* event_data);
@@ -0,0 +1,25 @@
+#ifndef CLOCK_SETTINGS_H
+#define CLOCK_SETTINGS_H
+
+#include <stdint.h>
+
+#include "clock/ThermalModel.h"
+
+// Settings of main.cpp for the host tests. Keep them in line with the defines there.
+static const uint32_t PULSE_WIDTH_MS = 350;
+static const uint32_t PULSE_INTERVAL_MS = 60;
+static const uint32_t PULSE_KICK_MS = 120;
+static const uint32_t PULSE_HOLD_DUTY = 40;
+static const uint32_t PULSE_COIL_MA = 100;
+static const float PULSE_SUPPLY_V = 24.0f;
+
+static const ThermalModel::Parameters THERMAL_PARAMETERS = {38.0f, 2.0f, 40.0f};
+
+// Pulse interval before the thermal model. Catch-ups must not get slower than this
+static const uint32_t FIXED_INTERVAL_MS = 150;
+
+// Heat of one pulse: supply voltage times the charge of DriveProfile::chargeUc()
+static const float PULSE_JOULES = PULSE_SUPPLY_V * PULSE_COIL_MA *
+  (PULSE_KICK_MS + (PULSE_WIDTH_MS - PULSE_KICK_MS) * PULSE_HOLD_DUTY / 100) / 1000000.0f;
+
+#endif // CLOCK_SETTINGS_H
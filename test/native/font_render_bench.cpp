@@ -0,0 +1,139 @@
+// Renders every time of a day ("00:00:00" to "23:59:59") with SubsetFont into a
+// host stand-in of the 1 bit sprite of main.cpp (stub/TFT_eSPI.h).
+//
+//   font_render_bench [results.json]
+//
+// Checks every frame pixel by pixel against the glyph tables of FontSubset.h
+// and that the widest time fits the sprite. Reports the table size, the
+// fillRect calls and the host time per frame, and the SPI time of the pushed
+// window at SPI_FREQUENCY. Exits with 1 on a failure.
+//
+// The host time is not the ESP32 time. On the device, loop() logs the render
+// time of the time display ("Time render: max .. us, avg .. us").
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "display/SubsetFont.h"
+
+static const uint32_t SPI_FREQUENCY = 40000000;   // platformio.ini
+static const int DAYS = 3;                         // Repetitions for the timing
+
+// Expected image of text, straight from the tables: one byte per screen pixel
+static void expected(const char* text, std::vector<uint8_t>& image, int32_t width) {
+  std::fill(image.begin(), image.end(), 0);
+  int32_t x = 0;
+
+  for (; *text != '\0'; text++) {
+    const FontSubset::Glyph* glyph = NULL;
+    for (uint8_t i = 0; i < FontSubset::GLYPH_COUNT; i++) {
+      if (FontSubset::GLYPHS[i].code == *text) {
+        glyph = &FontSubset::GLYPHS[i];
+      }
+    }
+    if (glyph == NULL) {
+      continue;
+    }
+    uint8_t rowBytes = (glyph->width + 7) / 8;
+    for (int32_t y = 0; y < FontSubset::HEIGHT * FontSubset::SCALE; y++) {
+      const uint8_t* row = &FontSubset::BITMAP[glyph->offset + y / FontSubset::SCALE * rowBytes];
+      for (int32_t column = 0; column < glyph->width * FontSubset::SCALE; column++) {
+        int32_t c = column / FontSubset::SCALE;
+        if (x + column < width && (row[c / 8] & (0x80 >> (c % 8)))) {
+          image[y * width + x + column] = 1;
+        }
+      }
+    }
+    x += glyph->advance * FontSubset::SCALE;
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* output = argc > 1 ? argv[1] : "font_render_results.json";
+
+  // Same size as textSprite in main.cpp
+  TFT_eSprite sprite(SubsetFont::textWidth("00:00:00"), SubsetFont::height());
+
+  std::vector<std::string> times;
+  for (int second = 0; second < 24 * 3600; second++) {
+    char text[9];
+    snprintf(text, sizeof(text), "%02d:%02d:%02d", second / 3600, second / 60 % 60, second % 60);
+    times.push_back(text);
+  }
+
+  // Correctness and fillRect calls, one frame per time
+  int failed = 0;
+  uint32_t maxFillRects = 0;
+  uint64_t sumFillRects = 0;
+  int32_t maxWidth = 0;
+  std::vector<uint8_t> image(sprite.width() * sprite.height());
+  for (const std::string& time : times) {
+    const char* text = time.c_str();
+    int32_t width = SubsetFont::textWidth(text);
+    if (width > maxWidth) {
+      maxWidth = width;
+    }
+
+    sprite.fillSprite(0);
+    sprite.fillRects = 0;
+    SubsetFont::drawString(sprite, text, 0, 0, 1);
+    sumFillRects += sprite.fillRects;
+    if (sprite.fillRects > maxFillRects) {
+      maxFillRects = sprite.fillRects;
+    }
+
+    expected(text, image, sprite.width());
+    for (int32_t y = 0; y < sprite.height(); y++) {
+      for (int32_t x = 0; x < sprite.width(); x++) {
+        uint8_t want = image[y * sprite.width() + x];
+        if (sprite.readPixel(x, y) != want && failed++ < 5) {
+          printf("FAIL %s: pixel %d,%d is %u, expected %u\n", text, x, y, sprite.readPixel(x, y), want);
+        }
+      }
+    }
+  }
+  if (maxWidth > sprite.width()) {
+    printf("FAIL widest time %d px, sprite %d px\n", maxWidth, sprite.width());
+    failed++;
+  }
+
+  // Host time per frame: clear the sprite and draw the text, like drawDigits()
+  auto start = std::chrono::steady_clock::now();
+  for (int day = 0; day < DAYS; day++) {
+    for (const std::string& time : times) {
+      sprite.fillSprite(0);
+      SubsetFont::drawString(sprite, time.c_str(), 0, 0, 1);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  double frameNs = std::chrono::duration<double, std::nano>(end - start).count() / (DAYS * times.size());
+
+  // pushSprite() sends the window with 16 bits per pixel
+  uint32_t pushPixels = maxWidth * SubsetFont::height();
+  double pushUs = pushPixels * 16.0 * 1000000.0 / SPI_FREQUENCY;
+  uint32_t tableBytes = sizeof(FontSubset::BITMAP) + sizeof(FontSubset::GLYPHS);
+  uint32_t spriteBytes = (sprite.width() + 7) / 8 * sprite.height();
+
+  printf("tables %u bytes (bitmap %zu, %u glyphs), sprite %u bytes\n", tableBytes, sizeof(FontSubset::BITMAP),
+         FontSubset::GLYPH_COUNT, spriteBytes);
+  printf("%zu frames: fillRect max %u, avg %.1f per frame, host %.0f ns per frame\n", times.size(), maxFillRects,
+         (double)sumFillRects / times.size(), frameNs);
+  printf("push window %d x %d px, %.0f us at %u MHz SPI\n", maxWidth, SubsetFont::height(), pushUs,
+         SPI_FREQUENCY / 1000000);
+
+  FILE* file = fopen(output, "w");
+  if (file != NULL) {
+    fprintf(file,
+            "{\"frames\": %zu, \"table_bytes\": %u, \"bitmap_bytes\": %zu, \"glyphs\": %u, \"sprite_bytes\": %u, "
+            "\"fill_rects_max\": %u, \"fill_rects_avg\": %.1f, \"host_frame_ns\": %.0f, "
+            "\"push_pixels\": %u, \"push_us_at_spi\": %.0f, \"pixel_errors\": %d, \"pass\": %s}\n",
+            times.size(), tableBytes, sizeof(FontSubset::BITMAP), FontSubset::GLYPH_COUNT, spriteBytes, maxFillRects,
+            (double)sumFillRects / times.size(), frameNs, pushPixels, pushUs, failed, failed == 0 ? "true" : "false");
+    fclose(file);
+  }
+  printf("%d failed, results in %s\n", failed, output);
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+// Scenarios for HandTracker on the host: DST changes in several timezones,
+// NTP steps, a power cut and a WiFi outage with RTC drift, each on a 12-hour
+// and a 24-hour dial. A simulated time keeper and pulse task drive the tracker
+// the same way moveHands() and HandMover do on the clock.
+//
+//   hand_tracker_scenarios [results.json]
+//
+// Writes one JSON object per run and exits with 1 if a run exceeds its limits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "ClockSettings.h"
+#include "clock/HandTracker.h"
+
+static const int64_t TICK_MS = 1000;           // The time keeper polls every second
+static const int64_t PHASE_MS = 250;           // Ticks are not aligned to the second
+static const time_t YEAR_START = 1767225600;   // 2026-01-01 00:00:00 UTC
+
+static const int64_t MINUTE_MS = 60 * 1000;
+static const int64_t HOUR_MS = 60 * MINUTE_MS;
+
+// Pulse task: sends the backlog one pulse after the other, at least the pulse
+// interval apart and slower when the thermal model needs time to cool down.
+// The position changes at the end of a pulse, like HandPosition::step() in HandMover
+class SimMover {
+public:
+  SimMover(uint16_t dialMinutes, uint16_t position)
+    : _dialMinutes(dialMinutes), _position(position), _backlog(0), _requestMs(0), _lastEndMs(-1),
+      _thermal(THERMAL_PARAMETERS) {
+
+  }
+
+  void advance(uint16_t count, int64_t nowMs) {
+    if (_backlog == 0) {
+      _requestMs = nowMs;
+    }
+    _backlog += count;
+  }
+
+  // RAM is lost, the position survives in NVS
+  void powerCut() { _backlog = 0; }
+
+  // Send the pulses that end before untilMs
+  void run(int64_t untilMs) {
+    while (_backlog > 0) {
+      // HandMover::pulseWaitMs(), evaluated when the task looks at the backlog
+      int64_t fromMs = _requestMs > _lastEndMs ? _requestMs : _lastEndMs;
+      int64_t startMs = fromMs + _thermal.coolingTimeMs(PULSE_JOULES, (uint32_t)fromMs);
+      if (_lastEndMs >= 0 && startMs < _lastEndMs + PULSE_INTERVAL_MS) {
+        startMs = _lastEndMs + PULSE_INTERVAL_MS;
+      }
+      if (startMs + PULSE_WIDTH_MS > untilMs) {
+        break;
+      }
+      _lastEndMs = startMs + PULSE_WIDTH_MS;
+      _thermal.addHeat(PULSE_JOULES, (uint32_t)_lastEndMs);
+      _position = (_position + 1) % _dialMinutes;
+      _backlog--;
+    }
+  }
+
+  // HandMover::pulsePeriodMs()
+  uint32_t periodMs(uint16_t count, int64_t nowMs) const {
+    return _thermal.burstMs(count, PULSE_JOULES, PULSE_WIDTH_MS, PULSE_INTERVAL_MS, (uint32_t)nowMs) / count;
+  }
+
+  uint16_t position() const { return _position; }
+  uint16_t backlog() const { return _backlog; }
+  float peakK() const { return _thermal.peakK(); }
+
+private:
+  uint16_t _dialMinutes;
+  uint16_t _position;
+  uint16_t _backlog;
+  int64_t _requestMs;   // Time the backlog was requested
+  int64_t _lastEndMs;   // End of the last pulse, -1 for none
+  ThermalModel _thermal;
+};
+
+struct Event {
+  enum Kind { Step, PowerOff, PowerOn, Drift, Sync };
+  int64_t atMs;       // Simulated time since the start
+  Kind kind;
+  double value;       // Step in ms, drift in ppm
+};
+
+struct Limits {
+  uint32_t maxCorrectMs;     // Longest correction
+  uint16_t maxTrueError;     // Largest error against the true time while powered
+  uint32_t maxPulses;        // Pulses over the whole run
+  uint32_t maxCorrections;
+};
+
+struct Result {
+  std::string name;
+  std::string tz;
+  uint16_t dialMinutes;
+  HandTracker::Stats stats;
+  uint16_t maxTrueError;
+  uint16_t finalError;
+  Limits limits;
+  std::string failure;
+};
+
+static struct tm localTime(int64_t epochMs) {
+  time_t seconds = (time_t)(epochMs >= 0 ? epochMs / 1000 : (epochMs - 999) / 1000);
+  struct tm time;
+  localtime_r(&seconds, &time);
+  return time;
+}
+
+static uint16_t shorter(uint16_t difference, uint16_t dialMinutes) {
+  return difference < dialMinutes - difference ? difference : dialMinutes - difference;
+}
+
+// One step of moveHands() in main.cpp
+static void keepTime(HandTracker& tracker, SimMover& mover, const struct tm& time, uint16_t dialMinutes,
+                     int64_t nowMs) {
+  tracker.observe(tracker.difference(mover.position(), time), (uint32_t)nowMs);
+
+  uint16_t position = (mover.position() + mover.backlog()) % dialMinutes;
+  uint16_t forward = tracker.difference(position, time);
+  uint32_t pulseMs = forward > 1 ? mover.periodMs(forward, nowMs) : PULSE_WIDTH_MS + PULSE_INTERVAL_MS;
+  uint16_t count = tracker.plan(position, time, pulseMs);
+  if (count != 0) {
+    mover.advance(count, nowMs);
+    tracker.recordPulses(count, PULSE_WIDTH_MS);
+  }
+}
+
+static Result run(const std::string& name, const char* tz, uint16_t dialMinutes, time_t startUtc,
+                  int64_t durationMs, std::vector<Event> events, const Limits& limits) {
+  setenv("TZ", tz, 1);
+  tzset();
+
+  int64_t startMs = (int64_t)startUtc * 1000 + PHASE_MS;
+  HandTracker tracker(dialMinutes);
+  SimMover mover(dialMinutes, 0);
+
+  double offsetMs = 0;   // System time minus true time
+  double driftPpm = 0;
+  bool powered = true;
+  uint16_t maxTrueError = 0;
+  uint16_t trueError = 0;
+  size_t next = 0;
+
+  for (int64_t nowMs = 0; nowMs <= durationMs; nowMs += TICK_MS) {
+    offsetMs += driftPpm * TICK_MS / 1e6;
+    while (next < events.size() && events[next].atMs <= nowMs) {
+      const Event& event = events[next++];
+      switch (event.kind) {
+        case Event::Step: offsetMs += event.value; break;
+        case Event::PowerOff: powered = false; mover.powerCut(); break;
+        case Event::PowerOn: powered = true; break;
+        case Event::Drift: driftPpm = event.value; break;
+        case Event::Sync: offsetMs = 0; driftPpm = 0; break;
+      }
+    }
+    if (!powered) {
+      continue;
+    }
+    if (nowMs == 0) {
+      // The hands show the system time, which may be wrong until NTP steps it
+      mover = SimMover(dialMinutes, tracker.dialPosition(localTime(startMs + (int64_t)offsetMs)));
+    }
+
+    mover.run(nowMs);
+    uint16_t truePosition = tracker.dialPosition(localTime(startMs + nowMs));
+    trueError = shorter((truePosition - mover.position() + dialMinutes) % dialMinutes, dialMinutes);
+    if (trueError > maxTrueError) {
+      maxTrueError = trueError;
+    }
+
+    keepTime(tracker, mover, localTime(startMs + nowMs + (int64_t)offsetMs), dialMinutes, nowMs);
+  }
+
+  Result result = {name, tz, dialMinutes, tracker.stats(), maxTrueError, trueError, limits, ""};
+  char text[128];
+  if (result.finalError != 0) {
+    snprintf(text, sizeof(text), "final error %u min", result.finalError);
+    result.failure = text;
+  } else if (result.stats.maxCorrectMs > limits.maxCorrectMs) {
+    snprintf(text, sizeof(text), "correction %u ms > %u ms", result.stats.maxCorrectMs, limits.maxCorrectMs);
+    result.failure = text;
+  } else if (maxTrueError > limits.maxTrueError) {
+    snprintf(text, sizeof(text), "true error %u min > %u min", maxTrueError, limits.maxTrueError);
+    result.failure = text;
+  } else if (result.stats.pulses > limits.maxPulses) {
+    snprintf(text, sizeof(text), "%u pulses > %u", result.stats.pulses, limits.maxPulses);
+    result.failure = text;
+  } else if (result.stats.corrections > limits.maxCorrections) {
+    snprintf(text, sizeof(text), "%u corrections > %u", result.stats.corrections, limits.maxCorrections);
+    result.failure = text;
+  }
+  return result;
+}
+
+// DST changes of the year, to the minute. toDst is true for the spring change
+struct Transition {
+  time_t at;
+  bool toDst;
+};
+
+static std::vector<Transition> transitions(const char* tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+
+  std::vector<Transition> found;
+  struct tm before, after;
+  for (time_t hour = YEAR_START; hour < YEAR_START + 365 * 86400; hour += 3600) {
+    time_t end = hour + 3600;
+    localtime_r(&hour, &before);
+    localtime_r(&end, &after);
+    if (before.tm_isdst == after.tm_isdst) {
+      continue;
+    }
+    for (time_t minute = hour + 60; minute <= end; minute += 60) {
+      localtime_r(&minute, &after);
+      if (after.tm_isdst != before.tm_isdst) {
+        found.push_back({minute, after.tm_isdst > 0});
+        break;
+      }
+    }
+  }
+  return found;
+}
+
+static void writeJson(const char* path, const std::vector<Result>& results) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot write %s\n", path);
+    return;
+  }
+  fprintf(file, "[\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    fprintf(file,
+            "  {\"name\": \"%s\", \"tz\": \"%s\", \"dial_minutes\": %u, \"pass\": %s, \"failure\": \"%s\",\n"
+            "   \"max_error_min\": %u, \"max_correct_ms\": %u, \"corrections\": %u, \"pulses\": %u,\n"
+            "   \"max_true_error_min\": %u, \"final_error_min\": %u,\n"
+            "   \"limits\": {\"max_correct_ms\": %u, \"max_true_error_min\": %u, \"max_pulses\": %u, "
+            "\"max_corrections\": %u}}%s\n",
+            r.name.c_str(), r.tz.c_str(), r.dialMinutes, r.failure.empty() ? "true" : "false", r.failure.c_str(),
+            r.stats.maxErrorMinutes, r.stats.maxCorrectMs, r.stats.corrections, r.stats.pulses,
+            r.maxTrueError, r.finalError,
+            r.limits.maxCorrectMs, r.limits.maxTrueError, r.limits.maxPulses, r.limits.maxCorrections,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "]\n");
+  fclose(file);
+}
+
+// The hands have to go forward one hour: a burst of 60 pulses. The error
+// against the true time is one minute more at the tick before the burst
+static Limits spring(int hours) {
+  return {30000, 61, (uint32_t)hours * 60 + 60 + 1, 1};
+}
+
+// The hands are one hour ahead: they go round the dial or wait, whatever is
+// faster. Going round passes through the largest error, half the dial. It must
+// not take longer than a turn with the fixed interval used before the thermal model
+static Limits autumn(uint16_t dialMinutes, int hours) {
+  return {dialMinutes * (PULSE_WIDTH_MS + FIXED_INTERVAL_MS), (uint16_t)(dialMinutes / 2),
+          (uint32_t)hours * 60 + dialMinutes + 1, 1};
+}
+
+int main(int argc, char** argv) {
+  const char* output = argc > 1 ? argv[1] : "hand_tracker_results.json";
+  const char* europe = "CET-1CEST,M3.5.0,M10.5.0/3";
+  const time_t summerDay = 1781517630;   // 2026-06-15 10:00:30 UTC
+
+  std::vector<Result> results;
+  const uint16_t dials[] = {720, 1440};
+
+  for (uint16_t dial : dials) {
+    // Summer time starts and ends, including the 30 minute change of Lord Howe Island.
+    // A run starts two hours before the change and ends four hours after it
+    const char* zones[] = {europe, "EST5EDT,M3.2.0,M11.1.0", "AEST-10AEDT,M10.1.0,M4.1.0/3",
+                           "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0"};
+    for (const char* tz : zones) {
+      for (const Transition& transition : transitions(tz)) {
+        // Spring: one burst. Autumn: the hands go round the dial or wait, whatever is faster
+        Limits limits = transition.toDst ? spring(6) : autumn(dial, 6);
+        results.push_back(run(std::string(transition.toDst ? "dst_spring" : "dst_autumn"), tz, dial,
+                              transition.at - 2 * 3600 + 30, 6 * HOUR_MS, {}, limits));
+      }
+    }
+
+    // NTP corrects the RTC by one second just before and just after the minute,
+    // the worst case for an extra or a missing pulse. The run starts at second 30
+    results.push_back(run("ntp_step_plus_1s", europe, dial, summerDay, HOUR_MS,
+                          {{(10 * 60 + 29) * 1000, Event::Step, 1000}}, {0, 1, 60 + 1, 0}));
+    results.push_back(run("ntp_step_minus_1s", europe, dial, summerDay, HOUR_MS,
+                          {{(10 * 60 + 30) * 1000, Event::Step, -1000}}, {0, 1, 60 + 1, 0}));
+    // Hands five minutes ahead: within maxHoldMinutes() on both dials, they wait
+    results.push_back(run("ntp_step_minus_5min", europe, dial, summerDay, HOUR_MS,
+                          {{0, Event::Step, 5 * (double)MINUTE_MS}, {10 * MINUTE_MS, Event::Step, -5 * (double)MINUTE_MS}},
+                          {301000, 6, 60 - 5 + 1, 1}));
+
+    // The RTC starts one hour off, the first NTP sync steps it
+    results.push_back(run("ntp_step_plus_1h", europe, dial, summerDay, 3 * HOUR_MS,
+                          {{0, Event::Step, -(double)HOUR_MS}, {10 * MINUTE_MS, Event::Step, (double)HOUR_MS}},
+                          spring(3)));
+    results.push_back(run("ntp_step_minus_1h", europe, dial, summerDay, 3 * HOUR_MS,
+                          {{0, Event::Step, (double)HOUR_MS}, {10 * MINUTE_MS, Event::Step, -(double)HOUR_MS}},
+                          autumn(dial, 3)));
+
+    // Six hours without power, then one burst to catch up, faster than with the fixed interval
+    results.push_back(run("power_cut_6h", europe, dial, summerDay, 8 * HOUR_MS,
+                          {{HOUR_MS, Event::PowerOff, 0}, {7 * HOUR_MS, Event::PowerOn, 0}},
+                          {360 * (PULSE_WIDTH_MS + FIXED_INTERVAL_MS), 360, 2 * 60 + 360 + 1, 1}));
+
+    // Three days without WiFi: the RTC drifts by 13 s, then SNTP steps it back.
+    // The hands may be one minute off for these seconds, but never need a correction
+    results.push_back(run("wifi_outage_3d_fast", europe, dial, summerDay, 73 * HOUR_MS,
+                          {{0, Event::Drift, 50}, {72 * HOUR_MS, Event::Sync, 0}}, {0, 1, 73 * 60 + 1, 0}));
+    results.push_back(run("wifi_outage_3d_slow", europe, dial, summerDay, 73 * HOUR_MS,
+                          {{0, Event::Drift, -50}, {72 * HOUR_MS, Event::Sync, 0}}, {0, 1, 73 * 60 + 1, 0}));
+  }
+
+  // The hold limit must match plan(): hold at maxHoldMinutes() ahead, go round one minute more.
+  // The turn is the first burst on a cold coil, like the log in setup()
+  int failed = 0;
+  for (uint16_t dial : dials) {
+    HandTracker tracker(dial);
+    ThermalModel model(THERMAL_PARAMETERS);
+    uint16_t turn = dial - 1;
+    uint32_t pulseMs = model.burstMs(turn, PULSE_JOULES, PULSE_WIDTH_MS, PULSE_INTERVAL_MS, 0) / turn;
+    uint16_t hold = tracker.maxHoldMinutes(pulseMs);
+
+    struct tm time = {};
+    uint16_t at = tracker.dialPosition(time);
+    bool holds = tracker.plan((at + hold) % dial, time, pulseMs) == 0;
+    bool goesRound = tracker.plan((at + hold + 1) % dial, time, pulseMs) != 0;
+    printf("%-4s hold limit %4u: %u ms per pulse, turn %u s, hold up to %u min ahead\n",
+           holds && goesRound ? "ok" : "FAIL", dial, pulseMs, turn * pulseMs / 1000, hold);
+    if (!holds || !goesRound) {
+      failed++;
+    }
+  }
+
+  for (const Result& r : results) {
+    printf("%-4s %-20s %-38s %4u  error %4u min  correct %7u ms  pulses %5u  true error %4u min%s%s\n",
+           r.failure.empty() ? "ok" : "FAIL", r.name.c_str(), r.tz.c_str(), r.dialMinutes,
+           r.stats.maxErrorMinutes, r.stats.maxCorrectMs, r.stats.pulses, r.maxTrueError,
+           r.failure.empty() ? "" : "  ", r.failure.c_str());
+    if (!r.failure.empty()) {
+      failed++;
+    }
+  }
+  writeJson(output, results);
+  printf("%zu runs, %d failed, results in %s\n", results.size(), failed, output);
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Delta OTA download with connection cuts against tools/ota_standin.py.
+
+Builds a delta with tools/mkdelta.py, serves it with ota_standin.py --cut and
+fetches it like DeltaOta::update() does: every attempt opens the file from the
+start for the header, then resumes with a Range request at the sector stored
+as progress, applies block by block and stores the progress where the
+connection broke. Fails unless the download needed several resumes and the
+applied image matches the target.
+
+    ota_resume_test.py [results.json]
+"""
+
+import hashlib
+import http.client
+import json
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+
+TOOLS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools")
+sys.path.insert(0, TOOLS)
+sys.dont_write_bytecode = True  # No __pycache__ in tools/
+import mkdelta  # noqa: E402
+
+CUT = 10000            # Bytes per connection, more than the largest block
+MAX_ATTEMPTS = 200
+
+
+def images():
+    # A base image and a target with changed, inserted and appended code
+    rng = random.Random(39)
+    base = bytes(rng.getrandbits(8) for _ in range(192 * 1024))
+    fresh = bytes(rng.getrandbits(8) for _ in range(40 * 1024))
+    target = base[:20000] + fresh[:12000] + base[20000:90000] + base[90500:150000] + fresh[12000:] + base[150000:]
+    return base, target
+
+
+def read_exact(response, length):
+    data = b""
+    try:
+        while len(data) < length:
+            chunk = response.read(length - len(data))
+            if not chunk:
+                return None
+            data += chunk
+    except (http.client.IncompleteRead, ConnectionError):
+        return None
+    return data
+
+
+def open_range(port, offset):
+    connection = http.client.HTTPConnection("127.0.0.1", port, timeout=10)
+    connection.request("GET", "/firmware.delta", headers={"Range": "bytes=%d-" % offset})
+    response = connection.getresponse()
+    # Like DeltaOta::open(): 206, or 200 only from the start
+    if response.status != 206 and not (response.status == 200 and offset == 0):
+        raise AssertionError("HTTP status %d at offset %d" % (response.status, offset))
+    return connection, response
+
+
+def attempt(port, base, flash, progress, stats):
+    """One call of DeltaOta::update(). Returns True when all sectors are written."""
+    connection, response = open_range(port, 0)
+    stats["connections"] += 1
+    data = read_exact(response, mkdelta.HEADER.size)
+    if data is None:
+        connection.close()
+        return False
+    magic, sector_size, base_size, target_size, base_sha, target_sha = mkdelta.HEADER.unpack(data)
+    assert magic == mkdelta.MAGIC and sector_size == mkdelta.SECTOR_SIZE
+    assert hashlib.sha256(base[:base_size]).digest() == base_sha
+
+    sectors = (target_size + sector_size - 1) // sector_size
+    sector, offset = 0, mkdelta.HEADER.size
+    if progress.get("target") == target_sha and progress["sector"] < sectors:
+        sector, offset = progress["sector"], progress["offset"]
+        connection.close()
+        connection, response = open_range(port, offset)
+        stats["connections"] += 1
+        stats["resumes"] += 1
+
+    while sector < sectors:
+        data = read_exact(response, 4)
+        block = None
+        if data is not None:
+            (length,) = struct.unpack("<I", data)
+            assert length <= mkdelta.BLOCK_MAX
+            block = read_exact(response, length)
+        if block is None:
+            # Connection lost, store the progress like saveProgress()
+            progress.update(target=target_sha, sector=sector, offset=offset)
+            connection.close()
+            return False
+        start = sector * sector_size
+        content = mkdelta.apply_block(base, base_size, block)
+        flash[start:start + len(content)] = content
+        sector += 1
+        offset += 4 + length
+    connection.close()
+
+    progress.clear()
+    stats["sectors"] = sectors
+    return hashlib.sha256(bytes(flash[:target_size])).digest() == target_sha
+
+
+def main():
+    output = sys.argv[1] if len(sys.argv) > 1 else "ota_resume_results.json"
+    base, target = images()
+    delta = mkdelta.build(base, target)
+
+    stats = {"delta_bytes": len(delta), "cut_bytes": CUT, "connections": 0, "resumes": 0, "sectors": 0}
+    failure = ""
+    with tempfile.TemporaryDirectory() as directory:
+        with open(os.path.join(directory, "firmware.delta"), "wb") as f:
+            f.write(delta)
+        server = subprocess.Popen([sys.executable, os.path.join(TOOLS, "ota_standin.py"), "--port", "0",
+                                   "--directory", directory, "--cut", str(CUT)],
+                                  stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+        try:
+            port = int(server.stdout.readline().split()[-1])
+            flash = bytearray(b"\xff" * len(target))
+            progress = {}
+            done = False
+            for _ in range(MAX_ATTEMPTS):
+                if attempt(port, base, flash, progress, stats):
+                    done = True
+                    break
+            if not done:
+                failure = "no complete image after %d attempts" % MAX_ATTEMPTS
+            elif bytes(flash) != target:
+                failure = "applied image differs from the target"
+            elif stats["resumes"] < 2:
+                failure = "the cut did not force a resume"
+        except (AssertionError, ValueError, struct.error) as error:
+            failure = str(error) or "invalid data in the download"
+        finally:
+            server.terminate()
+            server.wait()
+
+    stats["pass"] = not failure
+    stats["failure"] = failure
+    with open(output, "w") as f:
+        json.dump(stats, f)
+        f.write("\n")
+    print("%-4s delta %d bytes, cut every %d bytes: %d connections, %d resumes, %d sectors%s" % (
+        "FAIL" if failure else "ok", stats["delta_bytes"], CUT, stats["connections"], stats["resumes"],
+        stats["sectors"], "  " + failure if failure else ""))
+    return 1 if failure else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
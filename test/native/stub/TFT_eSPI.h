@@ -0,0 +1,43 @@
+#ifndef TFT_ESPI_STUB_H
+#define TFT_ESPI_STUB_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Host stand-in for the 1 bit TFT_eSprite of TFT_eSPI, with the calls SubsetFont
+// makes. Counts the fillRect calls and clips like the library does.
+class TFT_eSprite {
+public:
+  TFT_eSprite(int16_t width, int16_t height) : fillRects(0), _width(width), _height(height) {
+    _pixels = new uint8_t[width * height];
+    fillSprite(0);
+  }
+  ~TFT_eSprite() { delete[] _pixels; }
+  TFT_eSprite(const TFT_eSprite&) = delete;
+  TFT_eSprite& operator=(const TFT_eSprite&) = delete;
+
+  uint32_t fillRects;   // fillRect calls since the last reset
+
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+
+  void fillSprite(uint32_t color) { memset(_pixels, color ? 1 : 0, _width * _height); }
+
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+    fillRects++;
+    for (int32_t row = y < 0 ? 0 : y; row < y + h && row < _height; row++) {
+      for (int32_t column = x < 0 ? 0 : x; column < x + w && column < _width; column++) {
+        _pixels[row * _width + column] = color ? 1 : 0;
+      }
+    }
+  }
+
+  uint8_t readPixel(int32_t x, int32_t y) const { return _pixels[y * _width + x]; }
+
+private:
+  int16_t _width;
+  int16_t _height;
+  uint8_t* _pixels;
+};
+
+#endif // TFT_ESPI_STUB_H
@@ -0,0 +1,154 @@
+// Catch-up bursts through ThermalModel with the pulse settings of main.cpp.
+// Each burst is scheduled like HandMover does it: at least the pulse interval
+// between two pulses, longer when the model needs time to cool down.
+//
+//   thermal_model_test [results.json]
+//
+// Checks that the fixed 150 ms interval used before the model stays below the
+// limit, that no catch-up is slower than with that interval, that the peak
+// never exceeds the limit, and that burstMs() predicts the simulated duration.
+// Exits with 1 on a failure.
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "ClockSettings.h"
+
+struct Burst {
+  uint32_t durationMs;
+  float peakK;
+};
+
+// Burst of count pulses starting at nowMs, as HandMover::run() sends it
+static Burst simulate(ThermalModel& model, uint16_t count, uint32_t nowMs) {
+  Burst burst = {0, 0};
+  uint32_t ms = nowMs;
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t wait = model.coolingTimeMs(PULSE_JOULES, ms);
+    if (i > 0 && wait < PULSE_INTERVAL_MS) {
+      wait = PULSE_INTERVAL_MS;
+    }
+    ms += wait + PULSE_WIDTH_MS;
+    model.addHeat(PULSE_JOULES, ms);
+    if (model.temperatureK(ms) > burst.peakK) {
+      burst.peakK = model.temperatureK(ms);
+    }
+  }
+  burst.durationMs = ms - nowMs;
+  return burst;
+}
+
+struct Result {
+  std::string name;
+  uint16_t pulses;
+  uint32_t durationMs;
+  uint32_t predictedMs;
+  uint32_t fixedMs;
+  float peakK;
+  std::string failure;
+};
+
+static Result run(const std::string& name, uint16_t pulses, uint16_t warmupPulses) {
+  ThermalModel model(THERMAL_PARAMETERS);
+
+  // A warm start: a burst right before, like a second correction after a hold
+  uint32_t nowMs = 1000;
+  if (warmupPulses > 0) {
+    nowMs += simulate(model, warmupPulses, nowMs).durationMs;
+  }
+
+  Result result;
+  result.name = name;
+  result.pulses = pulses;
+  result.predictedMs = model.burstMs(pulses, PULSE_JOULES, PULSE_WIDTH_MS, PULSE_INTERVAL_MS, nowMs);
+  Burst burst = simulate(model, pulses, nowMs);
+  result.durationMs = burst.durationMs;
+  result.peakK = model.peakK();
+  result.fixedMs = pulses * PULSE_WIDTH_MS + (pulses - 1) * FIXED_INTERVAL_MS;
+
+  char text[128] = "";
+  if (result.peakK > THERMAL_PARAMETERS.limitK) {
+    snprintf(text, sizeof(text), "peak %.2f K > limit %.2f K", result.peakK, THERMAL_PARAMETERS.limitK);
+  } else if (result.durationMs > result.fixedMs) {
+    snprintf(text, sizeof(text), "slower than the fixed interval");
+  } else if (result.predictedMs != result.durationMs) {
+    snprintf(text, sizeof(text), "burstMs() %u ms, simulated %u ms", result.predictedMs, result.durationMs);
+  }
+  result.failure = text;
+  return result;
+}
+
+int main(int argc, char** argv) {
+  const char* output = argc > 1 ? argv[1] : "thermal_model_results.json";
+  std::vector<Result> results;
+
+  // Catch-ups: DST spring change, 30 minutes, power cut, turn of a 12 and a 24-hour dial
+  results.push_back(run("catch_up_60", 60, 0));
+  results.push_back(run("catch_up_30_warm", 30, 60));
+  results.push_back(run("catch_up_360", 360, 0));
+  results.push_back(run("catch_up_660", 660, 0));
+  results.push_back(run("catch_up_1380", 1380, 0));
+  results.push_back(run("catch_up_1380_warm", 1380, 720));
+
+  // The thermal model is there to make short catch-ups faster than before
+  Result& spring = results[0];
+  if (spring.failure.empty() && spring.durationMs >= spring.fixedMs) {
+    spring.failure = "not faster than the fixed interval";
+  }
+
+  // The parameters must allow the old fixed rate without a limit, a full turn of a 24-hour dial
+  ThermalModel fixed(THERMAL_PARAMETERS);
+  uint32_t ms = 1000;
+  for (int i = 0; i < 1440; i++) {
+    ms += PULSE_WIDTH_MS;
+    fixed.addHeat(PULSE_JOULES, ms);
+    ms += FIXED_INTERVAL_MS;
+  }
+  bool fixedBelowLimit = fixed.peakK() <= THERMAL_PARAMETERS.limitK;
+  printf("%-4s fixed interval peak %.2f K, limit %.2f K\n", fixedBelowLimit ? "ok" : "FAIL", fixed.peakK(),
+         THERMAL_PARAMETERS.limitK);
+
+  // The queries must not change the model
+  ThermalModel model(THERMAL_PARAMETERS);
+  model.addHeat(PULSE_JOULES, 1000);
+  float first = model.temperatureK(5000);
+  model.coolingTimeMs(PULSE_JOULES, 9000);
+  model.burstMs(100, PULSE_JOULES, PULSE_WIDTH_MS, PULSE_INTERVAL_MS, 9000);
+  bool constQueries = model.temperatureK(5000) == first && model.peakK() == PULSE_JOULES / THERMAL_PARAMETERS.capacitanceJK;
+
+  int failed = (constQueries ? 0 : 1) + (fixedBelowLimit ? 0 : 1);
+  if (!constQueries) {
+    printf("FAIL queries changed the model\n");
+  }
+
+  FILE* file = fopen(output, "w");
+  if (file != NULL) {
+    fprintf(file,
+            "{\"pulse_joules\": %.4f, \"limit_k\": %.1f, \"fixed_interval_peak_k\": %.2f, \"const_queries\": %s, "
+            "\"bursts\": [\n",
+            PULSE_JOULES, THERMAL_PARAMETERS.limitK, fixed.peakK(), constQueries ? "true" : "false");
+  }
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    printf("%-4s %-20s %5u pulses  %8u ms (fixed interval %8u ms)  peak %5.2f K%s%s\n",
+           r.failure.empty() ? "ok" : "FAIL", r.name.c_str(), r.pulses, r.durationMs, r.fixedMs, r.peakK,
+           r.failure.empty() ? "" : "  ", r.failure.c_str());
+    if (!r.failure.empty()) {
+      failed++;
+    }
+    if (file != NULL) {
+      fprintf(file,
+              "  {\"name\": \"%s\", \"pulses\": %u, \"duration_ms\": %u, \"predicted_ms\": %u, "
+              "\"fixed_interval_ms\": %u, \"peak_k\": %.2f, \"pass\": %s, \"failure\": \"%s\"}%s\n",
+              r.name.c_str(), r.pulses, r.durationMs, r.predictedMs, r.fixedMs, r.peakK,
+              r.failure.empty() ? "true" : "false", r.failure.c_str(), i + 1 < results.size() ? "," : "");
+    }
+  }
+  if (file != NULL) {
+    fprintf(file, "]}\n");
+    fclose(file);
+  }
+  printf("%zu bursts, %d failed, results in %s\n", results.size(), failed, output);
+  return failed == 0 ? 0 : 1;
+}
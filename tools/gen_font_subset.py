@@ -0,0 +1,335 @@
+#!/usr/bin/env python3
+"""Generate src/display/FontSubset.h with the glyphs the firmware draws.
+
+The glyphs are collected from "font-subset:" comments in src/, e.g.
+
+    // font-subset: 0123456789:
+
+or given with --glyphs. Only these glyphs end up in the firmware, as 1 bit
+per pixel tables drawn by src/display/SubsetFont.cpp.
+
+    python3 tools/gen_font_subset.py [--glyphs "0123456789:"] [--scale 2]
+
+Also runs as PlatformIO pre script (extra_scripts in platformio.ini) and
+rewrites the header only when it changes.
+"""
+
+import argparse
+import os
+import re
+
+# Glyph source, 13 rows. Add a glyph here before using it in the firmware
+GLYPHS = {
+    "0": """
+..###..
+.##.##.
+##...##
+##...##
+##...##
+##...##
+##...##
+##...##
+##...##
+##...##
+##...##
+.##.##.
+..###..
+""",
+    "1": """
+...##..
+..###..
+.####..
+...##..
+...##..
+...##..
+...##..
+...##..
+...##..
+...##..
+...##..
+...##..
+.######
+""",
+    "2": """
+.#####.
+##...##
+.....##
+.....##
+.....##
+....##.
+...##..
+..##...
+.##....
+##.....
+##.....
+##.....
+#######
+""",
+    "3": """
+.#####.
+##...##
+.....##
+.....##
+.....##
+..####.
+.....##
+.....##
+.....##
+.....##
+.....##
+##...##
+.#####.
+""",
+    "4": """
+....##.
+...###.
+..####.
+.##.##.
+##..##.
+##..##.
+#######
+....##.
+....##.
+....##.
+....##.
+....##.
+....##.
+""",
+    "5": """
+#######
+##.....
+##.....
+##.....
+######.
+.....##
+.....##
+.....##
+.....##
+.....##
+.....##
+##...##
+.#####.
+""",
+    "6": """
+..####.
+.##....
+##.....
+##.....
+##.....
+######.
+##...##
+##...##
+##...##
+##...##
+##...##
+##...##
+.#####.
+""",
+    "7": """
+#######
+.....##
+.....##
+....##.
+....##.
+...##..
+...##..
+..##...
+..##...
+..##...
+..##...
+..##...
+..##...
+""",
+    "8": """
+.#####.
+##...##
+##...##
+##...##
+##...##
+.#####.
+##...##
+##...##
+##...##
+##...##
+##...##
+##...##
+.#####.
+""",
+    "9": """
+.#####.
+##...##
+##...##
+##...##
+##...##
+##...##
+.######
+.....##
+.....##
+.....##
+.....##
+....##.
+.####..
+""",
+    ":": """
+..
+..
+..
+##
+##
+..
+..
+..
+##
+##
+..
+..
+..
+""",
+    "-": """
+.....
+.....
+.....
+.....
+.....
+.....
+#####
+.....
+.....
+.....
+.....
+.....
+.....
+""",
+    " ": """
+....
+....
+....
+....
+....
+....
+....
+....
+....
+....
+....
+....
+....
+""",
+}
+
+HEIGHT = 13
+SPACING = 1   # Columns between two glyphs
+MARKER = re.compile(r"font-subset:\s*(\S+)")
+OUTPUT = os.path.join("src", "display", "FontSubset.h")
+
+
+def scan(root):
+    glyphs = set()
+    for directory, _, files in os.walk(os.path.join(root, "src")):
+        for name in files:
+            path = os.path.join(directory, name)
+            if not name.endswith((".cpp", ".h")) or path.endswith(OUTPUT):
+                continue
+            with open(path, encoding="utf-8", errors="replace") as f:
+                for match in MARKER.finditer(f.read()):
+                    glyphs.update(match.group(1))
+    return glyphs
+
+
+def rows(code):
+    lines = GLYPHS[code].strip("\n").split("\n")
+    assert len(lines) == HEIGHT, "glyph %r needs %d rows" % (code, HEIGHT)
+    assert len(set(map(len, lines))) == 1, "glyph %r rows differ in width" % code
+    return lines
+
+
+def generate(glyphs, scale):
+    missing = sorted(set(glyphs) - set(GLYPHS))
+    if missing:
+        raise SystemExit("no glyph source for %s, add it to GLYPHS in tools/gen_font_subset.py" % missing)
+
+    entries = []
+    bitmap = []
+    for code in sorted(glyphs):
+        lines = rows(code)
+        width = len(lines[0])
+        literal = "'\\%s'" % code if code in "'\\" else "'%s'" % code
+        entries.append("  { %s, %d, %d, %d }," % (literal, width, width + SPACING, len(bitmap)))
+        for line in lines:
+            # MSB is the leftmost pixel, rows padded to whole bytes
+            bits = int(line.replace("#", "1").replace(".", "0").ljust((width + 7) // 8 * 8, "0"), 2)
+            bitmap.extend(bits.to_bytes((width + 7) // 8, "big"))
+
+    data = []
+    for i in range(0, len(bitmap), 13):
+        data.append("  " + " ".join("0x%02X," % b for b in bitmap[i:i + 13]))
+
+    return """// Generated by tools/gen_font_subset.py, do not edit.
+// Glyphs: "%s"
+#ifndef FONT_SUBSET_H
+#define FONT_SUBSET_H
+
+#include <stdint.h>
+
+namespace FontSubset {
+
+struct Glyph {
+  char code;
+  uint8_t width;     // Columns of the bitmap
+  uint8_t advance;   // Columns to the next glyph
+  uint16_t offset;   // First byte in BITMAP
+};
+
+constexpr uint8_t HEIGHT = %d;  // Rows of every glyph
+constexpr uint8_t SCALE = %d;   // Screen pixels per bitmap pixel
+
+// Sorted by code
+constexpr Glyph GLYPHS[] = {
+%s
+};
+
+constexpr uint8_t GLYPH_COUNT = sizeof(GLYPHS) / sizeof(GLYPHS[0]);
+
+// 1 bit per pixel, MSB left, every row padded to whole bytes
+constexpr uint8_t BITMAP[] = {
+%s
+};
+
+} // namespace FontSubset
+
+#endif // FONT_SUBSET_H
+""" % ("".join(sorted(glyphs)).replace("\\", "\\\\").replace('"', '\\"'), HEIGHT, scale,
+       "\n".join(entries), "\n".join(data))
+
+
+def write(root, glyphs, scale):
+    path = os.path.join(root, OUTPUT)
+    content = generate(glyphs, scale)
+    if os.path.exists(path):
+        with open(path, encoding="utf-8") as f:
+            if f.read() == content:
+                return False
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(content)
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--glyphs", help="glyphs to generate instead of the font-subset: comments")
+    parser.add_argument("--scale", type=int, default=2, help="screen pixels per bitmap pixel")
+    parser.add_argument("--root", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+    args = parser.parse_args()
+
+    glyphs = set(args.glyphs) if args.glyphs else scan(args.root)
+    changed = write(args.root, glyphs, args.scale)
+    print("%s: %d glyphs%s" % (OUTPUT, len(glyphs), "" if changed else ", unchanged"))
+
+
+try:
+    Import("env")  # noqa: F821, defined when PlatformIO runs this as extra script
+    if write(env.subst("$PROJECT_DIR"), scan(env.subst("$PROJECT_DIR")), 2):  # noqa: F821
+        print("Generated " + OUTPUT)
+except NameError:
+    if __name__ == "__main__":
+        main()
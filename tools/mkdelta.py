@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Build a compressed delta between two firmware images for the delta OTA.
+
+    python3 tools/mkdelta.py old/firmware.bin .pio/build/lilygo-t-display/firmware.bin firmware.delta
+
+old/firmware.bin must be the image running on the clocks. The delta is
+applied to a copy in memory and checked before it is written. Serve it with
+tools/ota_standin.py and set OTA_DELTA_URL in src/main.cpp.
+
+Format, little endian:
+  header: "SCD1", u32 sector size, u32 base size, u32 target size,
+          32 bytes SHA-256 of the base, 32 bytes SHA-256 of the target
+  then one block per sector of the target: u32 length, zlib data.
+  A block inflates to the ops that build the sector:
+    0x01 COPY   u32 base offset, u16 length
+    0x02 INSERT u16 length, data
+Every block is independent, so the device can resume at any sector.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"SCD1"
+SECTOR_SIZE = 4096
+OPS_MAX = 6144      # Inflated block, must match DeltaOta::OPS_MAX
+BLOCK_MAX = 6400    # Compressed block, must match DeltaOta::BLOCK_MAX
+KEY = 16            # Shortest copy
+STEP = 4            # Base positions indexed
+COPY, INSERT = 1, 2
+
+HEADER = struct.Struct("<4sIII32s32s")
+
+
+def index(base):
+    positions = {}
+    for offset in range(0, len(base) - KEY + 1, STEP):
+        positions.setdefault(base[offset:offset + KEY], offset)
+    return positions
+
+
+def match_length(base, source, target, position, end):
+    length = 0
+    while position + length < end and source + length < len(base) \
+            and base[source + length] == target[position + length]:
+        length += 1
+    return length
+
+
+def encode_sector(base, positions, target, start, end):
+    ops = bytearray()
+    pending = bytearray()
+
+    def flush():
+        if pending:
+            ops.extend(struct.pack("<BH", INSERT, len(pending)))
+            ops.extend(pending)
+            pending.clear()
+
+    position = start
+    while position < end:
+        # Same offset first, most code does not move between two builds
+        best_source, best_length = position, match_length(base, position, target, position, end)
+        candidate = positions.get(bytes(target[position:position + KEY]))
+        if candidate is not None and candidate != position:
+            length = match_length(base, candidate, target, position, end)
+            if length > best_length:
+                best_source, best_length = candidate, length
+
+        if best_length >= KEY:
+            flush()
+            ops.extend(struct.pack("<BIH", COPY, best_source, best_length))
+            position += best_length
+        else:
+            pending.append(target[position])
+            position += 1
+    flush()
+
+    if len(ops) > OPS_MAX:
+        ops = bytearray(struct.pack("<BH", INSERT, end - start)) + target[start:end]
+    block = zlib.compress(bytes(ops), 9)
+    assert len(block) <= BLOCK_MAX
+    return block
+
+
+def build(base, target):
+    positions = index(base)
+    blocks = []
+    for start in range(0, len(target), SECTOR_SIZE):
+        block = encode_sector(base, positions, target, start, min(start + SECTOR_SIZE, len(target)))
+        blocks.append(struct.pack("<I", len(block)) + block)
+    header = HEADER.pack(MAGIC, SECTOR_SIZE, len(base), len(target),
+                         hashlib.sha256(base).digest(), hashlib.sha256(target).digest())
+    return header + b"".join(blocks)
+
+
+def apply_block(base, base_size, block):
+    """Inflate one block and run its ops, like DeltaOta::applyBlock()."""
+    assert len(block) <= BLOCK_MAX
+    ops = zlib.decompress(block)
+    assert len(ops) <= OPS_MAX
+    sector = bytearray()
+    i = 0
+    while i < len(ops):
+        if ops[i] == COPY:
+            source, count = struct.unpack_from("<IH", ops, i + 1)
+            assert source + count <= base_size
+            sector += base[source:source + count]
+            i += 7
+        elif ops[i] == INSERT:
+            (count,) = struct.unpack_from("<H", ops, i + 1)
+            sector += ops[i + 3:i + 3 + count]
+            i += 3 + count
+        else:
+            raise ValueError("unknown op %d" % ops[i])
+    return bytes(sector)
+
+
+def apply(base, delta):
+    """Same steps as DeltaOta on the device, used to check the delta."""
+    magic, sector_size, base_size, target_size, base_sha, target_sha = HEADER.unpack_from(delta)
+    assert magic == MAGIC and sector_size == SECTOR_SIZE
+    assert hashlib.sha256(base[:base_size]).digest() == base_sha
+    target = bytearray()
+    offset = HEADER.size
+    while len(target) < target_size:
+        (length,) = struct.unpack_from("<I", delta, offset)
+        target += apply_block(base, base_size, delta[offset + 4:offset + 4 + length])
+        offset += 4 + length
+    assert offset == len(delta)
+    assert hashlib.sha256(target).digest() == target_sha
+    return bytes(target)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("base", help="image running on the clocks")
+    parser.add_argument("target", help="new image")
+    parser.add_argument("delta", help="output file")
+    args = parser.parse_args()
+
+    with open(args.base, "rb") as f:
+        base = f.read()
+    with open(args.target, "rb") as f:
+        target = f.read()
+
+    delta = build(base, target)
+    if apply(base, delta) != target:
+        sys.exit("delta check failed")
+    with open(args.delta, "wb") as f:
+        f.write(delta)
+    print("%s: %d bytes, %.1f %% of %d bytes, %d sectors" % (
+        args.delta, len(delta), 100.0 * len(delta) / len(target), len(target),
+        (len(target) + SECTOR_SIZE - 1) // SECTOR_SIZE))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""Minimal NTP server to test the multi-server sync of the firmware on the LAN.
+
+Run several instances with different delays to check that the sample with
+the lowest round-trip delay is chosen:
+
+    sudo python3 tools/ntp_standin.py --delay 0.005
+    sudo python3 tools/ntp_standin.py --port 1123 --delay 0.200 --asymmetry 0.150
+
+and put "<host ip>" or "<host ip>:<port>" into ntpservers[] in src/main.cpp.
+Port 123 needs root rights. --offset shifts the served time, e.g. to provoke a step.
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+NTP_UNIX_OFFSET = 2208988800
+
+
+def to_ntp(t):
+    seconds = int(t) + NTP_UNIX_OFFSET
+    fraction = int((t % 1) * (1 << 32))
+    return (seconds << 32) | fraction
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=123)
+    parser.add_argument("--offset", type=float, default=0.0, help="seconds added to the served time")
+    parser.add_argument("--delay", type=float, default=0.0, help="seconds to wait before answering")
+    parser.add_argument("--asymmetry", type=float, default=0.0,
+                        help="part of the delay hidden from the client (wrong offset)")
+    parser.add_argument("--stratum", type=int, default=2)
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", args.port))
+    print("NTP stand-in on port %d, offset %.3f s, delay %.3f s" % (args.port, args.offset, args.delay))
+
+    while True:
+        data, addr = sock.recvfrom(1024)
+        if len(data) < 48 or data[0] & 0x07 != 3:
+            continue
+        receive = time.time() + args.offset
+        time.sleep(args.delay)
+        # The asymmetric part of the delay is not reported, the client sees a wrong offset
+        transmit = time.time() + args.offset - args.asymmetry
+
+        reply = struct.pack("!BBbb11I", (0 << 6) | (4 << 3) | 4, args.stratum, 6, -20,
+                            0, 0, 0x4c4f434c, 0, 0, 0, 0, 0, 0, 0, 0)
+        reply = bytearray(reply)
+        struct.pack_into("!Q", reply, 16, to_ntp(receive))  # Reference timestamp
+        reply[24:32] = data[40:48]                          # Originate = client transmit
+        struct.pack_into("!Q", reply, 32, to_ntp(receive))  # Receive timestamp
+        struct.pack_into("!Q", reply, 40, to_ntp(transmit)) # Transmit timestamp
+        sock.sendto(bytes(reply), addr)
+        print("%s: answered after %.1f ms" % (addr[0], (time.time() + args.offset - receive) * 1000))
+
+
+if __name__ == "__main__":
+    main()
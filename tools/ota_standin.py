@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Minimal HTTP server with Range requests to test the delta OTA on the LAN.
+
+python3 -m http.server ignores the Range header, so a resumed download would
+start over. Serve the directory with the delta instead:
+
+    python3 tools/ota_standin.py --port 8000 --cut 100000
+
+and set OTA_DELTA_URL to "http://<host ip>:8000/firmware.delta" in src/main.cpp.
+--cut drops every connection after that many bytes, to check that the
+firmware resumes where it stopped. test/native/ota_resume_test.py does the
+same on the host.
+"""
+
+import argparse
+import functools
+import http.server
+import os
+import re
+
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+    cut = 0
+
+    def do_GET(self):
+        path = self.translate_path(self.path)
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return
+
+        size = os.path.getsize(path)
+        start, end = 0, size - 1
+        match = re.match(r"bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+        if match:
+            start = int(match.group(1))
+            if match.group(2):
+                end = min(int(match.group(2)), size - 1)
+            if start >= size:
+                self.send_error(416)
+                return
+            self.send_response(206)
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, size))
+        else:
+            self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(end - start + 1))
+        self.end_headers()
+
+        with open(path, "rb") as f:
+            f.seek(start)
+            remaining = end - start + 1
+            if self.cut:
+                remaining = min(remaining, self.cut)
+            while remaining > 0:
+                chunk = f.read(min(remaining, 4096))
+                self.wfile.write(chunk)
+                remaining -= len(chunk)
+        if self.cut:
+            self.close_connection = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=8000, help="0 picks a free port")
+    parser.add_argument("--directory", default=".")
+    parser.add_argument("--cut", type=int, default=0, help="drop connections after this many bytes")
+    args = parser.parse_args()
+
+    Handler.cut = args.cut
+    handler = functools.partial(Handler, directory=args.directory)
+    server = http.server.ThreadingHTTPServer(("", args.port), handler)
+    print("Serving %s on port %d" % (os.path.abspath(args.directory), server.server_address[1]), flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Compare the image size of two firmware builds by their linker map files.
+
+PlatformIO writes the map next to the image. Build both versions and keep the
+first one, e.g. for the font subset:
+
+    git checkout 382ec7f~1 && pio run && cp .pio/build/lilygo-t-display/firmware.* /tmp/before/
+    git checkout - && pio run
+    python3 tools/size_report.py /tmp/before/firmware.map .pio/build/lilygo-t-display/firmware.map
+
+Prints the size of both images (firmware.bin next to the map), the bytes per
+output section (flash, IRAM, DRAM) and the archives or objects whose size
+changed the most. Add --match to list only archives and objects containing a
+string, e.g. --match TFT_eSPI.
+"""
+
+import argparse
+import os
+import re
+
+# Input section line: optional name, address, size, object. Long names stand
+# on a line of their own, the numbers follow on the next one
+INPUT = re.compile(r"^ (\.\S+|COMMON)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+OUTPUT = re.compile(r"^(\.\S+)\s*(0x[0-9a-fA-F]+)?")
+
+
+def owner(path):
+    # "lib/libTFT_eSPI.a(TFT_eSPI.cpp.o)" -> "libTFT_eSPI.a", "src/main.cpp.o" -> "main.cpp.o"
+    path = path.strip()
+    if "(" in path:
+        path = path[:path.index("(")]
+    return os.path.basename(path)
+
+
+def parse(path):
+    sections = {}
+    owners = {}
+    output = None
+    inside = False
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line.startswith("Linker script and memory map"):
+                inside = True
+                continue
+            if not inside:
+                continue
+            if line.startswith("."):
+                match = OUTPUT.match(line)
+                output = match.group(1)
+                continue
+            match = INPUT.match(line)
+            if match:
+                address, size = int(match.group(2), 16), int(match.group(3), 16)
+                # Debug and other sections without a load address are not in the image
+                if address == 0 or size == 0 or output is None:
+                    continue
+                sections[output] = sections.get(output, 0) + size
+                key = owner(match.group(4))
+                owners[key] = owners.get(key, 0) + size
+    return sections, owners
+
+
+def image_size(map_path):
+    path = os.path.splitext(map_path)[0] + ".bin"
+    return os.path.getsize(path) if os.path.exists(path) else None
+
+
+def table(title, before, after, keys):
+    print("\n%-40s %10s %10s %10s" % (title, "before", "after", "delta"))
+    for key in keys:
+        a, b = before.get(key, 0), after.get(key, 0)
+        print("%-40s %10d %10d %+10d" % (key[:40], a, b, b - a))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before", help="map file of the old build")
+    parser.add_argument("after", help="map file of the new build")
+    parser.add_argument("--top", type=int, default=15, help="archives and objects to list")
+    parser.add_argument("--match", default="", help="list only archives and objects containing this")
+    args = parser.parse_args()
+
+    sections_before, owners_before = parse(args.before)
+    sections_after, owners_after = parse(args.after)
+
+    bin_before, bin_after = image_size(args.before), image_size(args.after)
+    if bin_before is not None and bin_after is not None:
+        print("%-40s %10d %10d %+10d" % ("firmware.bin", bin_before, bin_after, bin_after - bin_before))
+
+    keys = sorted(set(sections_before) | set(sections_after))
+    table("output section", sections_before, sections_after, keys)
+
+    keys = [k for k in set(owners_before) | set(owners_after) if args.match in k]
+    keys.sort(key=lambda k: -abs(owners_after.get(k, 0) - owners_before.get(k, 0)))
+    table("archive / object", owners_before, owners_after, keys[:args.top])
+
+
+if __name__ == "__main__":
+    main()
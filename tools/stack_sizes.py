@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Derive the task stack sizes of config/TaskConfig.h from a load test log.
+
+loop() logs the stack use of every task once a minute:
+
+    I (123456) main: Stack MoveHands: 1480 of 3072 bytes used
+
+Build the firmware with -DSLAVECLOCK_LOAD_TEST, let it run for some hours and
+save the serial monitor output. Then:
+
+    python3 tools/stack_sizes.py monitor.log
+
+prints the most bytes each task used and the stack size that keeps the
+headroom above it, rounded up to 256 bytes.
+"""
+
+import argparse
+import re
+
+STACK = re.compile(r"Stack (\S+): (\d+) of (\d+) bytes used")
+
+
+def parse(lines):
+    used = {}
+    for line in lines:
+        match = STACK.search(line)
+        if match:
+            name, bytes_used, size = match.group(1), int(match.group(2)), int(match.group(3))
+            peak, _, samples = used.get(name, (0, size, 0))
+            used[name] = (max(peak, bytes_used), size, samples + 1)
+    return used
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", help="serial monitor output of a load test")
+    parser.add_argument("--headroom", type=int, default=1024, help="TASK_STACK_HEADROOM in bytes")
+    args = parser.parse_args()
+
+    with open(args.log, errors="replace") as f:
+        used = parse(f)
+    if not used:
+        raise SystemExit("no stack lines in " + args.log)
+
+    print("%-12s %8s %8s %8s %9s" % ("task", "samples", "used", "size", "derived"))
+    for name, (peak, size, samples) in sorted(used.items()):
+        derived = (peak + args.headroom + 255) // 256 * 256
+        print("%-12s %8d %8d %8d %9d%s" % (name, samples, peak, size, derived,
+                                             "  too small" if derived > size else ""))
+
+
+if __name__ == "__main__":
+    main()
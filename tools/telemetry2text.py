@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Decode the telemetry messages of the slave clock firmware.
+
+Set TELEMETRY_BROKER_URI in src/main.cpp, run a local broker (e.g. mosquitto)
+and subscribe with hex output:
+
+    mosquitto_sub -h localhost -t 'slaveclock/+/telemetry' -F '%x' | python3 tools/telemetry2text.py
+
+Every line of hex is one message. Gaps in the sequence numbers are records
+lost before they were sent, repeated numbers are QoS 1 duplicates.
+"""
+
+import struct
+import sys
+import time
+
+HEADER = struct.Struct("<BBBBII")
+RECORD = struct.Struct("<IBBHi")
+
+RESET_REASONS = ["unknown", "poweron", "ext", "sw", "panic", "int_wdt", "task_wdt", "wdt",
+                 "deepsleep", "brownout", "sdio"]
+
+
+def describe(kind, a, b):
+    if kind == 1:
+        return "boot       reason %s" % (RESET_REASONS[a] if a < len(RESET_REASONS) else a)
+    if kind == 2:
+        return "sync       offset %d ms, delay %d ms" % (b, a)
+    if kind == 3:
+        return "drift      %d min, %s" % (a, "%d pulses" % b if b else "waiting")
+    if kind == 4:
+        return "pulses     total %d, max lateness %d ms" % (b, a)
+    if kind == 5:
+        return "heap       free %d bytes, largest block %d KiB" % (b, a)
+    if kind == 6:
+        return "stack      lowest high water mark %d bytes" % a
+    return "type %d     a %d, b %d" % (kind, a, b)
+
+
+def decode(message):
+    magic, version, count, size, first, dropped = HEADER.unpack_from(message)
+    if magic != ord("T") or version != 1 or size != RECORD.size:
+        raise ValueError("unknown message format")
+    if dropped:
+        print("# %d records dropped on the device so far" % dropped)
+    for i in range(count):
+        stamp, kind, _, a, b = RECORD.unpack_from(message, HEADER.size + i * size)
+        when = time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(stamp))
+        print("%8d %s %s" % (first + i, when, describe(kind, a, b)))
+
+
+def main():
+    for line in sys.stdin:
+        line = line.strip()
+        if not line:
+            continue
+        try:
+            decode(bytes.fromhex(line))
+        except ValueError as error:
+            print("# skipped: %s" % error)
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Convert a trace dump of the slave clock firmware to Chrome/Perfetto JSON.
+
+Build the firmware with -DSLAVECLOCK_TRACE, send 't' over the serial monitor
+and save the output. Then:
+
+    python3 tools/trace2json.py monitor.log > trace.json
+
+and open trace.json in https://ui.perfetto.dev or chrome://tracing.
+"""
+
+import json
+import sys
+
+TASK_SWITCH, MUTEX_WAIT, MUTEX_TAKE, MUTEX_GIVE, PULSE_START, PULSE_END, MARK = range(1, 8)
+
+MUTEX_NAMES = {1: "tftMutex"}
+PULSE_TRACK = 100
+
+
+def parse(lines):
+    tasks = {}
+    events = []
+    inside = False
+    for line in lines:
+        line = line.strip()
+        if line == "TRACE BEGIN":
+            tasks, events, inside = {}, [], True
+        elif line == "TRACE END":
+            inside = False
+        elif inside and line.startswith("T "):
+            _, task, name = line.split(" ", 2)
+            tasks[int(task)] = name
+        elif inside and line.startswith("E "):
+            events.append([int(v) for v in line.split()[1:]])
+    return tasks, events
+
+
+def unwrap(events):
+    # Timestamps are 32 bit microseconds and wrap after ~71 minutes
+    offset, last = 0, None
+    for event in events:
+        if last is not None and event[0] + offset < last:
+            offset += 1 << 32
+        event[0] += offset
+        last = event[0]
+
+
+def convert(tasks, events):
+    out = []
+
+    def name(task):
+        return tasks.get(task, "task%d" % task)
+
+    for cpu in (0, 1):
+        out.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": cpu,
+                    "args": {"name": "CPU %d" % cpu}})
+    out.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": PULSE_TRACK,
+                "args": {"name": "H-bridge"}})
+    for task in tasks:
+        out.append({"ph": "M", "name": "thread_name", "pid": 1, "tid": task,
+                    "args": {"name": name(task)}})
+
+    running = {}     # cpu -> (task, start)
+    waiting = {}     # (task, mutex) -> start
+    holding = {}     # (task, mutex) -> start
+    pulse = None
+
+    for ts, cpu, task, event, arg in events:
+        if event == TASK_SWITCH:
+            if cpu in running:
+                prev, start = running[cpu]
+                out.append({"ph": "X", "name": name(prev), "pid": 0, "tid": cpu,
+                            "ts": start, "dur": ts - start})
+            running[cpu] = (task, ts)
+        elif event == MUTEX_WAIT:
+            waiting[(task, arg)] = ts
+        elif event == MUTEX_TAKE:
+            start = waiting.pop((task, arg), ts)
+            mutex = MUTEX_NAMES.get(arg, "mutex%d" % arg)
+            if ts > start:
+                out.append({"ph": "X", "name": "wait " + mutex, "pid": 1, "tid": task,
+                            "ts": start, "dur": ts - start})
+            holding[(task, arg)] = ts
+        elif event == MUTEX_GIVE:
+            start = holding.pop((task, arg), None)
+            if start is not None:
+                out.append({"ph": "X", "name": MUTEX_NAMES.get(arg, "mutex%d" % arg),
+                            "pid": 1, "tid": task, "ts": start, "dur": ts - start})
+        elif event == PULSE_START:
+            pulse = ts
+        elif event == PULSE_END and pulse is not None:
+            out.append({"ph": "X", "name": "pulse", "pid": 0, "tid": PULSE_TRACK,
+                        "ts": pulse, "dur": ts - pulse, "args": {"polarity": arg}})
+            pulse = None
+        elif event == MARK:
+            out.append({"ph": "i", "name": "mark", "pid": 1, "tid": task, "ts": ts,
+                        "s": "t", "args": {"value": arg}})
+
+    return {"traceEvents": out, "displayTimeUnit": "ms"}
+
+
+def main():
+    source = open(sys.argv[1], errors="replace") if len(sys.argv) > 1 else sys.stdin
+    tasks, events = parse(source)
+    if not events:
+        sys.exit("No trace found in input")
+    unwrap(events)
+    json.dump(convert(tasks, events), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()